@@ -0,0 +1,124 @@
+/*
+ * LoggerBench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *
+ * Measures the cost of a CVLog line, of a single token within a line and
+ * of printing a matrix, with and without converting its rows in bulk, or
+ * by reference on the backend thread.
+ * Records go to a sink that drops them, so the numbers cover formatting
+ * only; with Logger::Quiet the call sites would be skipped altogether.
+ * logger_bench uses the inline fast paths with opencv_logger,
+ * logger_bench_static with opencv_logger_static (optionally with
+ * -DOPENCV_LOGGER_LTO=ON) and logger_bench_outofline calls them in
+ * opencv_logger_outofline, built with CVLOG_OUT_OF_LINE as before they were
+ * inlined. Results are in the README.
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <time.h>
+
+#include "Logger.h"
+#include "LogSink.h"
+
+using namespace nl_uu_science_gmt;
+
+static double now()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+class NullSink: public LogSink
+{
+public:
+	void write(Logger::LogLevel, const std::string &)
+	{
+	}
+};
+
+static double lineCost(int tokens, int iterations)
+{
+	double start = now();
+	for (int i = 0; i < iterations; ++i)
+	{
+		Logger logger = CVLog(INFO);
+		for (int t = 0; t < tokens; t += 2)
+			logger << "a" << i;
+	}
+	return (now() - start) / iterations;
+}
+
+/*
+ * Lowest of a few runs, as the time stamp of each record costs more than
+ * its tokens and other load only ever adds to it
+ */
+static double bestLineCost(int tokens, int iterations)
+{
+	double best = lineCost(tokens, iterations);
+	for (int run = 1; run < 5; ++run)
+		best = std::min(best, lineCost(tokens, iterations));
+	return best;
+}
+
+static double matrixCost(const cv::Mat &matrix, bool cells, int iterations)
+{
+	TextCells::setEnabled(cells);
+	double start = now();
+	for (int i = 0; i < iterations; ++i)
+		CVLog(INFO) << matrix;
+	return (now() - start) / iterations / matrix.total();
+}
+
+/*
+ * Time the logging thread spends on a matrix logged by reference, which the
+ * backend prints
+ */
+static double referenceCost(const cv::Mat &matrix, int iterations)
+{
+	Logger::AsyncQueue = iterations + 1;
+	double start = now();
+	for (int i = 0; i < iterations; ++i)
+		CVLog(INFO) << Logger::ref(matrix);
+	const double cost = (now() - start) / iterations;
+
+	Logger::flushQueue();
+	Logger::AsyncQueue = 0;
+	return cost;
+}
+
+int main(int argc, char** argv)
+{
+	const int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+	Logger::addSink(cv::Ptr<LogSink>(new NullSink()));
+
+	// warm up
+	lineCost(2, iterations / 10);
+
+	// a token costs a few ns, so it is taken over long lines
+	const double short_line = bestLineCost(2, iterations);
+	const double long_line = bestLineCost(34, iterations);
+	const double longest_line = bestLineCost(1026, iterations / 32);
+
+	printf("ns per line (2 tokens):  %10.1f\n", short_line);
+	printf("ns per line (34 tokens): %10.1f\n", long_line);
+	printf("ns per token:            %10.1f\n", (longest_line - short_line) / 1024);
+
+	cv::Mat bytes(64, 64, CV_8UC1), floats(64, 64, CV_32FC1);
+	cv::randu(bytes, 0, 256);
+	cv::randu(floats, -1000, 1000);
+
+	const int matrices = iterations / 100 + 1;
+	printf("ns per 8UC1 value:       %10.1f (sprintf %.1f)\n", matrixCost(bytes, true, matrices),
+			matrixCost(bytes, false, matrices));
+	printf("ns per 32FC1 value:      %10.1f (sprintf %.1f)\n", matrixCost(floats, true, matrices),
+			matrixCost(floats, false, matrices));
+	TextCells::setEnabled(true);
+
+	printf("ns per 32FC1 matrix:     %10.1f (by reference %.1f)\n", matrixCost(floats, true, matrices) * floats.total(),
+			referenceCost(floats, matrices));
+
+	return EXIT_SUCCESS;
+}
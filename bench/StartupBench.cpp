@@ -0,0 +1,57 @@
+/*
+ * StartupBench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *
+ * Startup cost of the logger. With "exit" as argument main returns at once,
+ * so timing many runs measures loading the library and its static
+ * initialisers (see bench/startup.sh). Otherwise the first console and
+ * log-file records, which set up the configuration, the call site registry
+ * and the log-file, are timed against the records after them.
+ */
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+
+#include "Logger.h"
+
+using namespace nl_uu_science_gmt;
+
+static double now()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double record(const char* text)
+{
+	const double start = now();
+	CVLog(INFO) << text;
+	return now() - start;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && strcmp(argv[1], "exit") == 0) return EXIT_SUCCESS;
+
+	const double first = record("first console record");
+	const double next = record("next console record");
+
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/logger_startup_%d.txt", (int) getpid());
+	Logger::LogFileName = std::string(path);
+	Logger::LogToFile = true;
+	Logger::Quiet = true;
+
+	const double first_file = record("first log-file record");
+	const double next_file = record("next log-file record");
+	unlink(path);
+
+	fprintf(stderr, "ns first / next console record:  %10.0f %10.0f\n", first, next);
+	fprintf(stderr, "ns first / next log-file record: %10.0f %10.0f\n", first_file, next_file);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+# Startup and compile time of the logger. Run from a build directory made
+# with -DOPENCV_LOGGER_BUILD_BENCH=ON:
+# sh ../bench/startup.sh [runs]
+#
+# Times process start up to main (library loading and static initialisers),
+# the first records, and compiling a source file that includes Logger.h
+# against one that only includes LoggerFwd.h.
+
+RUNS=${1:-200}
+SOURCE_DIR=$(cd "$(dirname "$0")/.." && pwd)
+CXX=${CXX:-c++}
+CXXFLAGS="-std=c++11 -I$SOURCE_DIR/include $(pkg-config --cflags opencv4 2>/dev/null || pkg-config --cflags opencv 2>/dev/null)"
+
+nanos()
+{
+	date +%s%N
+}
+
+start=$(nanos)
+i=0
+while [ $i -lt "$RUNS" ]; do
+	./logger_startup exit
+	i=$((i + 1))
+done
+echo "us per process start:            $(( ($(nanos) - start) / RUNS / 1000 ))"
+
+./logger_startup > /dev/null
+
+TMP=$(mktemp -d)
+printf '#include "Logger.h"\nvoid f(nl_uu_science_gmt::Logger&);\n' > "$TMP/full.cpp"
+printf '#include "LoggerFwd.h"\nvoid f(nl_uu_science_gmt::Logger&);\n' > "$TMP/fwd.cpp"
+for header in full fwd; do
+	start=$(nanos)
+	$CXX $CXXFLAGS -fsyntax-only "$TMP/$header.cpp" || exit 1
+	lines=$($CXX $CXXFLAGS -E "$TMP/$header.cpp" | wc -l)
+	echo "ms to compile ($header header):     $(( ($(nanos) - start) / 1000000 )), $lines preprocessed lines"
+done
+rm -rf "$TMP"
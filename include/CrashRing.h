@@ -0,0 +1,53 @@
+/*
+ * CrashRing.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef CRASHRING_H_
+#define CRASHRING_H_
+
+#include <atomic>
+#include <string>
+
+namespace nl_uu_science_gmt
+{
+
+/*
+ * Keeps the last records of every thread in memory, at every level and
+ * whether or not they were written anywhere, so there is context to look at
+ * after a crash even when running with Logger::Quiet.
+ *
+ * Each thread writes into its own ring, so recording takes no lock. On
+ * SIGSEGV, SIGABRT, SIGBUS, SIGFPE and SIGILL the rings are dumped to the
+ * file given to install(), using async-signal-safe calls only, after which
+ * the signal is handled as it was before.
+ */
+class CrashRing
+{
+	static std::atomic<bool> _enabled;
+
+public:
+	/*
+	 * Starts recording with a ring of 'capacity' bytes per thread and installs
+	 * the signal handlers. Only the first call has effect.
+	 */
+	static void install(const std::string &dump_file, size_t capacity = 64 * 1024);
+
+	static bool isEnabled()
+	{
+		return _enabled.load(std::memory_order_relaxed);
+	}
+
+	static void record(const char*, size_t);
+
+	/*
+	 * Writes the rings of all threads, oldest record first, to the given file
+	 * or the one given to install(). Async-signal-safe. Returns false if the
+	 * file could not be written.
+	 */
+	static bool dump(const char* file_name = NULL);
+};
+
+} /* namespace nl_uu_science_gmt */
+#endif /* CRASHRING_H_ */
@@ -0,0 +1,54 @@
+/*
+ * ImageWriter.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef IMAGEWRITER_H_
+#define IMAGEWRITER_H_
+
+#include <string>
+
+#include "opencv2/core/core.hpp"
+
+namespace nl_uu_science_gmt
+{
+
+/*
+ * Writes thumbnails of logged images to files on a worker thread, so the
+ * logging thread never waits for encoding or the disk.
+ *
+ * Images wait in a bounded queue; when it is full new images are dropped
+ * and counted rather than blocking the caller.
+ */
+class ImageWriter
+{
+public:
+	/*
+	 * Directory the images are written to (by default the directory of the
+	 * log-file), the longest side of a thumbnail in pixels, the number of
+	 * images that may wait for the worker and the file extension, which
+	 * selects the encoder (".png", ".jpg", ..)
+	 */
+	static void configure(const std::string &directory, int max_side = 320, size_t capacity = 16,
+			const std::string &extension = ".png");
+
+	static int getMaxSide();
+
+	/*
+	 * Queues an image for writing and returns the name of the file it will be
+	 * written to, or an empty string if the queue is full. The image must not
+	 * be modified afterwards.
+	 */
+	static std::string write(const cv::Mat &image, const char* name = NULL);
+
+	/*
+	 * Blocks until all queued images have been written
+	 */
+	static void flush();
+
+	static size_t getDropped();
+};
+
+} /* namespace nl_uu_science_gmt */
+#endif /* IMAGEWRITER_H_ */
@@ -0,0 +1,221 @@
+/*
+ * JsonWriter.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef JSONWRITER_H_
+#define JSONWRITER_H_
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+namespace nl_uu_science_gmt
+{
+
+/*
+ * Appends JSON to a string the caller owns. Nothing is allocated besides the
+ * growth of that string, so a buffer that is cleared and reused per record
+ * stops allocating once it has reached the size of the largest record.
+ *
+ * Separators are the caller's business: the writer emits values, keys and
+ * the punctuation of the compound OpenCV types only.
+ */
+class JsonWriter
+{
+	std::string &_out;
+
+public:
+	explicit JsonWriter(std::string &out) :
+			_out(out)
+	{
+	}
+
+	std::string& str()
+	{
+		return _out;
+	}
+
+	JsonWriter& raw(const char* text)
+	{
+		_out.append(text);
+		return *this;
+	}
+
+	JsonWriter& raw(const char* text, size_t length)
+	{
+		_out.append(text, length);
+		return *this;
+	}
+
+	JsonWriter& key(const char* name)
+	{
+		string(name);
+		_out.push_back(':');
+		return *this;
+	}
+
+	JsonWriter& string(const char* text)
+	{
+		return string(text, strlen(text));
+	}
+
+	JsonWriter& string(const std::string &text)
+	{
+		return string(text.data(), text.length());
+	}
+
+	JsonWriter& string(const char*, size_t);
+
+	JsonWriter& value(bool input)
+	{
+		return raw(input ? "true" : "false");
+	}
+
+	JsonWriter& value(const char* input)
+	{
+		return string(input);
+	}
+
+	JsonWriter& value(const std::string &input)
+	{
+		return string(input);
+	}
+
+	JsonWriter& value(uchar input)
+	{
+		return value((long) input);
+	}
+
+	JsonWriter& value(schar input)
+	{
+		return value((long) input);
+	}
+
+	JsonWriter& value(short input)
+	{
+		return value((long) input);
+	}
+
+	JsonWriter& value(ushort input)
+	{
+		return value((long) input);
+	}
+
+	JsonWriter& value(int input)
+	{
+		return value((long) input);
+	}
+
+	JsonWriter& value(unsigned int input)
+	{
+		return value((long unsigned int) input);
+	}
+
+	JsonWriter& value(long long input)
+	{
+		return value((long) input);
+	}
+
+	JsonWriter& value(float input)
+	{
+		return value((double) input);
+	}
+
+	JsonWriter& value(long);
+	JsonWriter& value(long unsigned int);
+	JsonWriter& value(double);
+
+	template<typename T>
+	JsonWriter& value(const cv::Point_<T> &input)
+	{
+		raw("{\"x\":").value(input.x);
+		raw(",\"y\":").value(input.y);
+		return raw("}");
+	}
+
+	template<typename T>
+	JsonWriter& value(const cv::Size_<T> &input)
+	{
+		raw("{\"w\":").value(input.width);
+		raw(",\"h\":").value(input.height);
+		return raw("}");
+	}
+
+	template<typename T>
+	JsonWriter& value(const cv::Rect_<T> &input)
+	{
+		raw("{\"x\":").value(input.x);
+		raw(",\"y\":").value(input.y);
+		raw(",\"w\":").value(input.width);
+		raw(",\"h\":").value(input.height);
+		return raw("}");
+	}
+
+	JsonWriter& value(const cv::Range &input)
+	{
+		raw("{\"start\":").value(input.start);
+		raw(",\"end\":").value(input.end);
+		return raw("}");
+	}
+
+	template<typename T>
+	JsonWriter& value(const cv::Scalar_<T> &input)
+	{
+		return value(static_cast<const cv::Vec<T, 4>&>(input));
+	}
+
+	template<typename T, int c>
+	JsonWriter& value(const cv::Vec<T, c> &input)
+	{
+		_out.push_back('[');
+		for (int i = 0; i < c; ++i)
+		{
+			if (i > 0) _out.push_back(',');
+			value(input.val[i]);
+		}
+		return raw("]");
+	}
+
+	/*
+	 * {"type":"CV_32FC2","size":[rows,cols],"data":[...]} with the elements
+	 * (and their channels) flattened in row-major order
+	 */
+	JsonWriter& value(const cv::Mat&);
+
+	template<typename T>
+	JsonWriter& value(const cv::Mat_<T> &input)
+	{
+		return value(static_cast<const cv::Mat&>(input));
+	}
+
+	template<typename T>
+	JsonWriter& value(const std::vector<T> &input)
+	{
+		_out.push_back('[');
+		for (size_t i = 0; i < input.size(); ++i)
+		{
+			if (i > 0) _out.push_back(',');
+			value(input[i]);
+		}
+		return raw("]");
+	}
+
+	/*
+	 * Anything else is written as a string through its std::ostream operator
+	 */
+	template<typename T>
+	JsonWriter& value(const T &input)
+	{
+		std::ostringstream text;
+		text << input;
+		return string(text.str());
+	}
+};
+
+} /* namespace nl_uu_science_gmt */
+#endif /* JSONWRITER_H_ */
@@ -0,0 +1,75 @@
+/*
+ * LogContext.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef LOGCONTEXT_H_
+#define LOGCONTEXT_H_
+
+#include <sstream>
+#include <string>
+
+#include "Logger.h"
+
+namespace nl_uu_science_gmt
+{
+
+/*
+ * Key/value pair attached to every record of this thread for the lifetime
+ * of the object:
+ * LogContext::setThreadName("grabber");
+ * LogContext camera("camera", id);
+ * for (..) { LogContext frame("frame", n); CVLog(INFO) << "grabbed"; }
+ *
+ * gives "... INFO  [grabber camera=2 frame=17]\tgrabbed" in text records and
+ * "thread_name" and "ctx":{"camera":2,"frame":17} members in JSON records.
+ *
+ * The context is rendered once when a LogContext is made or destroyed;
+ * records copy the rendered text. Contexts nest like scopes and must be
+ * destroyed on the thread that made them. An inner context hides an outer
+ * one with the same key.
+ */
+class LogContext
+{
+	LogContext(const LogContext &);
+	LogContext& operator=(const LogContext &);
+
+	void push(const char* key, const std::string &text, const std::string &json);
+
+public:
+	/*
+	 * Rendered context of a thread, empty strings without context
+	 */
+	struct Tags
+	{
+		std::string text; // " [name key=value ...]"
+		std::string json; // ,"thread_name":"name","ctx":{"key":value,..}
+	};
+
+	template<typename T>
+	LogContext(const char* key, const T &value)
+	{
+		std::ostringstream text;
+		text << value;
+
+		std::string json;
+		JsonWriter(json).value(value);
+
+		push(key, text.str(), json);
+	}
+
+	~LogContext();
+
+	/*
+	 * Names the calling thread in its records, and on Linux also for top and
+	 * gdb (truncated to 15 characters there)
+	 */
+	static void setThreadName(const std::string &);
+	static std::string getThreadName();
+
+	static const Tags& getTags();
+};
+
+} /* namespace nl_uu_science_gmt */
+#endif /* LOGCONTEXT_H_ */
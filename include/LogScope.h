@@ -0,0 +1,74 @@
+/*
+ * LogScope.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef LOGSCOPE_H_
+#define LOGSCOPE_H_
+
+#include <stdint.h>
+
+#include "Logger.h"
+
+#define CVLOG_CONCAT_(a, b) a##b
+#define CVLOG_CONCAT(a, b) CVLOG_CONCAT_(a, b)
+
+/*
+ * Times the rest of the enclosing scope:
+ * CVLogScope("detect");
+ */
+#define CVLogScope(name) nl_uu_science_gmt::LogScope CVLOG_CONCAT(__cvlog_scope_, __LINE__)(name, __FILE__, __LINE__)
+
+/*
+ * Named timer that can be read and stopped before the end of the scope:
+ * CVLogTimer(timer, "track");
+ * ...
+ * timer.stop();
+ */
+#define CVLogTimer(var, name) nl_uu_science_gmt::LogScope var(name, __FILE__, __LINE__)
+
+namespace nl_uu_science_gmt
+{
+
+/*
+ * Measures the time between its construction and stop() or destruction on
+ * the monotonic clock. With Logger::Tracing enabled this becomes a DEBUG
+ * record, "stage: 1.23400 ms" indented by the nesting depth of the scopes on
+ * this thread, which sinks with LAYOUT_TRACE write as a trace event.
+ *
+ * With Logger::Tracing disabled a scope costs a config load and a read of
+ * the clock. The name has to outlive the scope, its record keeps a copy.
+ */
+class LogScope
+{
+	const char* const _name;
+	const char* const _file;
+	const int _line;
+	int64_t _start;
+	int _depth;
+	bool _running;
+
+public:
+	LogScope(const char* name, const char* file = "", int line = 0);
+
+	~LogScope()
+	{
+		if (_running) stop();
+	}
+
+	/*
+	 * Microseconds since the scope started, also when tracing is disabled
+	 */
+	int64_t elapsed() const
+	{
+		return getMonotonicTime() - _start;
+	}
+
+	void stop();
+
+	static int64_t getMonotonicTime();
+};
+
+} /* namespace nl_uu_science_gmt */
+#endif /* LOGSCOPE_H_ */
@@ -0,0 +1,343 @@
+/*
+ * LogSink.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef LOGSINK_H_
+#define LOGSINK_H_
+
+#include <stdint.h>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "Logger.h"
+
+namespace nl_uu_science_gmt
+{
+
+/*
+ * Destination for log records, registered with Logger::addSink.
+ *
+ * A sink receives every record at or above its level (DEBUG < INFO < WARN <
+ * ERROR), rendered in its layout. The string is shared by all sinks with the
+ * same layout and is only valid for the duration of the call. write() may be
+ * called from several threads at once.
+ */
+class LogSink
+{
+	const Logger::LogLevel _level;
+	const Logger::LogLayout _layout;
+
+public:
+	LogSink(Logger::LogLevel level = Logger::LOG_DEBUG, Logger::LogLayout layout = Logger::LAYOUT_TEXT) :
+			_level(level), _layout(layout)
+	{
+	}
+
+	virtual ~LogSink()
+	{
+	}
+
+	virtual void write(Logger::LogLevel, const std::string &) = 0;
+
+	/*
+	 * Time and call site of a record
+	 */
+	struct Origin
+	{
+		timeval time;
+		const std::string &file;
+		int line;
+	};
+
+	/*
+	 * The logger calls this one; sinks that need the origin of a record
+	 * override it
+	 */
+	virtual void write(Logger::LogLevel level, const std::string &record, const Origin &)
+	{
+		write(level, record);
+	}
+
+	/*
+	 * Writes out what the sink buffers. Logger::flushSinks() calls it, also
+	 * at exit, as the sinks still registered then are never destroyed.
+	 */
+	virtual void flush()
+	{
+	}
+
+	bool accepts(Logger::LogLevel level) const
+	{
+		return Logger::getSeverity(level) >= Logger::getSeverity(_level);
+	}
+
+	Logger::LogLevel getLevel() const
+	{
+		return _level;
+	}
+
+	Logger::LogLayout getLayout() const
+	{
+		return _layout;
+	}
+};
+
+/*
+ * INFO to std::cout, DEBUG to std::clog, WARN and ERROR to std::cerr
+ */
+class ConsoleSink: public LogSink
+{
+	const bool _color;
+	std::mutex _mutex;
+
+public:
+	ConsoleSink(Logger::LogLevel level = Logger::LOG_DEBUG, Logger::LogLayout layout = Logger::LAYOUT_TEXT, bool color =
+			false) :
+			LogSink(level, layout), _color(color && layout == Logger::LAYOUT_TEXT)
+	{
+	}
+
+	void write(Logger::LogLevel, const std::string &);
+};
+
+/*
+ * Appends to a file that stays open for the lifetime of the sink.
+ *
+ * Records are buffered and handed to the kernel according to the
+ * FlushPolicy, so at most that many records or milliseconds are lost when
+ * the process dies. With sync the data is also fdatasync'ed after every
+ * flush, on a worker thread, which bounds the loss on a power failure
+ * without a blocking syscall in write().
+ *
+ * With setIndex the sink also writes a sidecar index, <file>.idx, that
+ * tools/LogQuery.cpp uses to find records by time, level and call site
+ * without reading the log. The index assumes the sink is the only writer
+ * of the file.
+ */
+class FileSink: public LogSink
+{
+public:
+	struct FlushPolicy
+	{
+		size_t records; // flush after this many records, 0: off
+		int interval; // ms after the oldest unflushed record, 0: off
+		bool warnings; // flush WARN and ERROR records right away
+		bool sync; // fdatasync after a flush
+
+		FlushPolicy(size_t records = 0, int interval = 0, bool warnings = false, bool sync = false) :
+				records(records), interval(interval), warnings(warnings), sync(sync)
+		{
+		}
+	};
+
+private:
+	const std::string _file_name;
+	const FlushPolicy _policy;
+	FILE* _file;
+
+	std::mutex _mutex;
+	std::condition_variable _ready;
+	size_t _unflushed; // records
+	std::chrono::steady_clock::time_point _oldest; // of the unflushed records
+	bool _sync;
+	bool _stop;
+	std::atomic<size_t> _syncs;
+	std::thread _worker;
+
+	/*
+	 * Records of one level and call site in one time bucket, since the
+	 * index was last written
+	 */
+	struct IndexBlock
+	{
+		uint32_t count;
+		uint64_t first; // offset of the first record
+		uint64_t end; // offset just past the last record
+		std::string records; // varint (gap, length) pairs after the first record
+	};
+
+	typedef std::map<std::tuple<int, std::string, int>, IndexBlock> IndexBlocks; // level, file, line
+
+	FILE* _index;
+	int64_t _bucket; // ms, 0: no index
+	int64_t _bucket_start; // us since the epoch
+	uint64_t _offset; // size of the log-file
+	IndexBlocks _blocks;
+
+	void open(Logger::LogLayout);
+	void flushLocked();
+	void writeIndex();
+	void run();
+
+public:
+	FileSink(const std::string &, Logger::LogLevel level = Logger::LOG_DEBUG, Logger::LogLayout layout =
+			Logger::LAYOUT_TEXT, bool flush = false);
+	FileSink(const std::string &, const FlushPolicy &, Logger::LogLevel level = Logger::LOG_DEBUG,
+			Logger::LogLayout layout = Logger::LAYOUT_TEXT);
+	~FileSink();
+
+	void write(Logger::LogLevel, const std::string &);
+	void write(Logger::LogLevel, const std::string &, const Origin &);
+
+	/*
+	 * Flushes now, and syncs if the policy does
+	 */
+	void flush();
+
+	/*
+	 * Starts writing <file>.idx with buckets of the given size (ms).
+	 * Returns false if the index cannot be opened.
+	 */
+	bool setIndex(int bucket = 1000);
+
+	bool isOpen() const
+	{
+		return _file != NULL;
+	}
+
+	size_t getSyncs() const
+	{
+		return _syncs.load(std::memory_order_relaxed);
+	}
+};
+
+/*
+ * Keeps the last records in memory, e.g. for tests or to show in a UI
+ */
+class MemorySink: public LogSink
+{
+	const size_t _capacity;
+	std::deque<std::string> _records;
+	mutable std::mutex _mutex;
+
+public:
+	MemorySink(size_t capacity = 1024, Logger::LogLevel level = Logger::LOG_DEBUG, Logger::LogLayout layout =
+			Logger::LAYOUT_TEXT) :
+			LogSink(level, layout), _capacity(capacity)
+	{
+	}
+
+	void write(Logger::LogLevel, const std::string &);
+
+	std::vector<std::string> getRecords() const;
+	void clear();
+};
+
+/*
+ * Writes newline terminated records into a fixed size, memory mapped file
+ * that wraps around when full. The pages belong to the kernel's page cache,
+ * so the last records survive a crash of the process.
+ *
+ * The file starts with a RingHeader; the oldest record starts at
+ * position % capacity once position exceeds the capacity.
+ */
+class MmapRingSink: public LogSink
+{
+public:
+	struct RingHeader
+	{
+		char magic[8]; // "CVLOGRNG"
+		uint64_t capacity;
+		uint64_t position; // total number of bytes written
+	};
+
+private:
+	RingHeader* _header;
+	char* _data;
+	size_t _mapped;
+	std::mutex _mutex;
+
+public:
+	MmapRingSink(const std::string &, size_t capacity = 1 << 20, Logger::LogLevel level = Logger::LOG_DEBUG,
+			Logger::LogLayout layout = Logger::LAYOUT_TEXT);
+	~MmapRingSink();
+
+	void write(Logger::LogLevel, const std::string &);
+
+	bool isOpen() const
+	{
+		return _header != NULL;
+	}
+};
+
+/*
+ * Sends every record as one datagram in syslog format ("<PRI>ident: record")
+ * to a local Unix socket, /dev/log by default. Sending never blocks, records
+ * the socket cannot take are dropped.
+ */
+class SyslogSink: public LogSink
+{
+	const std::string _path;
+	const std::string _ident;
+	int _socket;
+
+public:
+	SyslogSink(const std::string &path = "/dev/log", const std::string &ident = "opencv_logger",
+			Logger::LogLevel level = Logger::LOG_INFO, Logger::LogLayout layout = Logger::LAYOUT_TEXT);
+	~SyslogSink();
+
+	void write(Logger::LogLevel, const std::string &);
+};
+
+/*
+ * Streams records to a collector process over a local Unix socket, a
+ * stream (SOCK_STREAM) or datagram (SOCK_SEQPACKET, SOCK_DGRAM) socket.
+ *
+ * Each record is framed as a 4-byte big-endian length, followed by that
+ * many bytes: the level (one byte, LogLevel) and the record. write() only
+ * appends the frame to a bounded backlog; a worker thread sends it, and
+ * connects and reconnects to the collector. Frames that do not fit in the
+ * backlog while the collector is slow or away are dropped and counted. A
+ * frame is never sent in part after a reconnect. See tools/LogCollector.cpp.
+ */
+class SocketSink: public LogSink
+{
+	const std::string _path;
+	const int _type;
+	const size_t _capacity;
+
+	std::mutex _mutex;
+	std::condition_variable _ready;
+	std::string _backlog; // whole frames, the first one sent up to _sent
+	size_t _sent;
+	bool _stop;
+	std::atomic<size_t> _dropped;
+	std::atomic<bool> _connected;
+	std::thread _worker;
+
+	void run();
+
+public:
+	SocketSink(const std::string &path, int type = SOCK_STREAM, size_t capacity = 1 << 20, Logger::LogLevel level =
+			Logger::LOG_DEBUG, Logger::LogLayout layout = Logger::LAYOUT_TEXT);
+	~SocketSink();
+
+	void write(Logger::LogLevel, const std::string &);
+
+	bool isConnected() const
+	{
+		return _connected.load(std::memory_order_relaxed);
+	}
+
+	size_t getDropped() const
+	{
+		return _dropped.load(std::memory_order_relaxed);
+	}
+};
+
+} /* namespace nl_uu_science_gmt */
+#endif /* LOGSINK_H_ */
@@ -15,23 +15,104 @@
 #include <ctime>
 #include <sys/time.h>
 
+#include <atomic>
 #include <deque>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-#include <boost/filesystem/operations.hpp>
-#include <boost/filesystem/convenience.hpp>
-
 #include "opencv2/core/core.hpp"
 
-#define CVLog(level) nl_uu_science_gmt::Logger::create(nl_uu_science_gmt::Logger::LOG_##level, __FILE__, __LINE__)
+#include "CrashRing.h"
+#include "JsonWriter.h"
+#include "LoggerFwd.h"
+#include "MessageBuffer.h"
+#include "TextCells.h"
+
+/*
+ * Module tag of the CVLog call sites in a file, for Logger::setLevel. Define
+ * it before including Logger.h: #define CVLOG_MODULE "tracker"
+ */
+#ifndef CVLOG_MODULE
+#define CVLOG_MODULE NULL
+#endif
+
+/*
+ * Every call site registers itself once and keeps its state in a flag that
+ * is only updated when the module levels or the settings change. A disabled
+ * site costs that load and a branch to the preallocated logger of the
+ * thread, the conditional skips the insertions that follow, they are neither
+ * evaluated nor formatted. Both branches are lvalues, Logger l = CVLog(INFO)
+ * takes the record over from the temporary.
+ */
+#define CVLog(level) nl_uu_science_gmt::Logger::isSiteDisabled([]() -> const nl_uu_science_gmt::Logger::CallSite& { \
+		static nl_uu_science_gmt::Logger::CallSite __cvlog_site(nl_uu_science_gmt::Logger::LOG_##level, __FILE__, __LINE__, \
+		CVLOG_MODULE); return __cvlog_site; }()) ? nl_uu_science_gmt::Logger::disabled() : nl_uu_science_gmt::Logger::create( \
+		nl_uu_science_gmt::Logger::LOG_##level, __FILE__, __LINE__, nl_uu_science_gmt::Logger::getSiteState()).self()
+
+/*
+ * CVLogF(INFO, "{} at {} took {}ms", rect, point, ms);
+ * The format string must be a literal, its placeholders are counted and checked
+ * against the arguments at compile time. Use {{ and }} for literal braces.
+ */
+#define CVLogF(level, ...) CVLog(level).format<nl_uu_science_gmt::Logger::countFormatArgs(CVLOG_FORMAT_STRING(__VA_ARGS__, ""))>(__VA_ARGS__)
+#define CVLOG_FORMAT_STRING(format, ...) format
 
 namespace nl_uu_science_gmt
 {
 
+/*
+ * Value that is only computed when the record it is logged to is written,
+ * see lazy()
+ */
+template<typename F>
+struct Lazy
+{
+	F function;
+};
+
+/*
+ * CVLog(DEBUG) << "norm: " << cvlog::lazy([&] { return cv::norm(a, b); });
+ * The function runs when it is logged, and only if the record reaches the
+ * console, the log-file or a sink; it is not evaluated for the crash ring
+ */
+template<typename F>
+inline Lazy<F> lazy(F function)
+{
+	Lazy<F> l = { function };
+	return l;
+}
+
+/*
+ * Prints values of a type Logger has no operator<< for straight into the
+ * record; without a specialization they go through a std::stringstream:
+ *
+ * template<>
+ * struct cvlog::formatter<Track>
+ * {
+ * 	static void format(cvlog::Logger &log, const Track &track)
+ * 	{
+ * 		log << "#" << track.id << " at " << track.position;
+ * 	}
+ * };
+ *
+ * OpenCV types without an operator<< of their own are specialized below
+ * the Logger class.
+ */
+template<typename T>
+struct formatter
+{
+};
+
 class Logger
 {
+	friend class LogScope;
+	friend struct CallSiteRegistry;
+
 public:
 	enum LogLevel
 	{
@@ -41,117 +122,702 @@ public:
 	{
 		FORMAT_DEFAULT, FORMAT_MATLAB, FORMAT_CSV, FORMAT_C, FORMAT_OPENCV
 	};
+	/*
+	 * LAYOUT_TRACE only carries the timings of CVLogScope/CVLogTimer, as
+	 * Chrome trace-event objects (chrome://tracing, Perfetto)
+	 */
+	enum LogLayout
+	{
+		LAYOUT_TEXT, LAYOUT_JSON, LAYOUT_TRACE
+	};
 
-	static bool Quiet;
-	static bool Debug;
-	static bool LogToFile;
-	static bool Fixed;
-	static bool Flush;
-	static bool Color;
-
-	static size_t Precision;
-	static size_t ReferenceWidth;
-	static size_t Size;
-	static LogFormat OutputFormat;
-	static LogLevel Level;
-	static std::string LogFileName;
-
-	const static std::string Color_RED;
-	const static std::string Color_GREEN;
-	const static std::string Color_BLUE;
-	const static std::string Color_YELLOW;
-	const static std::string Color_CYAN;
-	const static std::string Color_RESET;
+	/*
+	 * Per call site verdict of the module levels (see setLevel): no level
+	 * applies, written regardless of Level, Quiet and Debug, or not at all.
+	 * A site that the settings or the sinks would not write is disabled as
+	 * well, unless the CrashRing keeps its records.
+	 */
+	enum SiteState
+	{
+		SITE_DEFAULT, SITE_ENABLED, SITE_DISABLED
+	};
 
-private:
-	struct Stream
+	/*
+	 * A CVLog statement, registered with the module levels on first use
+	 */
+	class CallSite
 	{
-		Stream(LogLevel l) :
-				log_level(l), log_filename("")
+		const LogLevel _level;
+		const char* const _file;
+		const int _line;
+		const char* const _module;
+		std::atomic<int> _state;
+		CallSite* _next;
+
+		friend struct CallSiteRegistry;
+
+	public:
+		CallSite(LogLevel, const char* file, int line, const char* module);
+
+		int getState() const
 		{
+			return _state.load(std::memory_order_relaxed);
 		}
-		Stream(LogLevel l, const std::string &f) :
-				log_level(l), log_filename(f)
+	};
+
+	/*
+	 * Reads the state of a CVLog call site once; the create() of the same
+	 * statement takes it from getSiteState()
+	 */
+	static bool isSiteDisabled(const CallSite &site)
+	{
+		const int state = site.getState();
+		if (state == SITE_DISABLED) return true;
+
+		siteState() = state;
+		return false;
+	}
+
+	static int getSiteState()
+	{
+		return siteState();
+	}
+
+	/*
+	 * Sets the least important level written by the call sites whose module
+	 * tag (CVLOG_MODULE) or file name matches the glob, overriding Level,
+	 * Quiet and Debug for them. The last matching pattern applies. A pattern
+	 * is matched against the base name without .cpp ("tracker*"), or against
+	 * the path as the compiler passed it when it contains a slash.
+	 * Levels: DEBUG, INFO, WARN, ERROR or OFF. The environment variable
+	 * CVLOG_LEVELS="tracker=DEBUG,*io*=WARN" is read on first use.
+	 */
+	static bool setLevel(const std::string &pattern, const std::string &level);
+	static void setLevel(const std::string &pattern, LogLevel);
+	static void clearLevels();
+
+	/*
+	 * Reads "pattern = LEVEL" lines, # starts a comment. Returns false if the
+	 * file cannot be read or has an invalid line.
+	 */
+	static bool loadLevels(const std::string &file_name);
+
+	/*
+	 * Key/value pair attached to a record: appended as " key=value" to text
+	 * records and as a typed member of JSON records (see Logger::field)
+	 */
+	template<typename T>
+	struct Field
+	{
+		const char* key;
+		const T& value;
+	};
+
+	/*
+	 * Matrix logged relative to the value it had the previous time it was
+	 * logged under the same tag, or from the same call site (see Logger::delta)
+	 */
+	struct Delta
+	{
+		const cv::Mat& mat;
+		double tolerance;
+		const char* tag;
+	};
+
+	typedef std::vector<cv::Ptr<LogSink> > SinkList;
+
+	/*
+	 * Immutable snapshot of all settings. Loggers take the current one with a
+	 * single atomic load; changing a setting publishes a new snapshot. A former
+	 * snapshot is freed, with the sinks only it refers to, once no logger and
+	 * no queued record holds it any more.
+	 */
+	struct Config
+	{
+		Config();
+
+		bool quiet;
+		bool debug;
+		bool log_to_file;
+		bool fixed;
+		bool flush;
+		bool color;
+		bool tracing;
+
+		size_t precision;
+		size_t reference_width;
+		size_t size;
+		LogFormat output_format;
+		LogLayout output_layout;
+		LogLevel level;
+		std::string log_file_name;
+		size_t coalesce_window;
+		bool stable_layout;
+		size_t async_queue;
+
+		std::shared_ptr<const SinkList> sinks;
+		int layouts; // bit per LogLayout records have to be rendered in
+		unsigned long version;
+	};
+
+	/*
+	 * The current snapshot, which stays valid until the settings change;
+	 * copyConfig() is safe while other threads change settings
+	 */
+	static const Config* getConfig();
+	static Config copyConfig();
+	static void configure(const Config &);
+
+	/*
+	 * Static setting that reads from and publishes to the current Config, so
+	 * Logger::Quiet = true; is safe while other threads log
+	 */
+	template<typename T>
+	class Setting
+	{
+		T Config::* const _member;
+
+	public:
+		explicit constexpr Setting(T Config::* member) :
+				_member(member)
+		{
+		}
+
+		operator T() const
+		{
+			const T value = pinConfig()->*_member;
+			unpinConfig();
+			return value;
+		}
+
+		Setting& operator=(const T &value)
+		{
+			{
+				std::lock_guard<std::mutex> lock(getConfigMutex());
+				Config config(*getConfig());
+				config.*_member = value;
+				publish(config);
+			}
+			reclaimConfigs();
+			return *this;
+		}
+
+		Setting& operator=(const Setting &other)
+		{
+			return *this = (T) other;
+		}
+	};
+
+	static Setting<bool> Quiet;
+	static Setting<bool> Debug;
+	static Setting<bool> LogToFile;
+	static Setting<bool> Fixed;
+	static Setting<bool> Flush;
+	static Setting<bool> Color;
+	static Setting<bool> Tracing; // CVLogScope and CVLogTimer write records
+
+	static Setting<size_t> Precision;
+	static Setting<size_t> ReferenceWidth;
+	static Setting<size_t> Size;
+	static Setting<LogFormat> OutputFormat;
+	static Setting<LogLayout> OutputLayout;
+	static Setting<LogLevel> Level; // least important level written to the console and LogFileName
+	static Setting<std::string> LogFileName;
+
+	/*
+	 * Milliseconds within which identical consecutive records of a thread,
+	 * from the same call site, are collapsed into one line with a repeat
+	 * count (0: off)
+	 */
+	static Setting<size_t> CoalesceWindow;
+
+	/*
+	 * Matrices logged again from the same call site with the same type and
+	 * shape reuse the column widths of the last time, widened where values
+	 * have grown, instead of measuring every column first. Keeps columns
+	 * aligned from frame to frame.
+	 */
+	static Setting<bool> StableLayout;
+
+	/*
+	 * Records that may wait for the backend thread, which formats the
+	 * matrices logged with Logger::ref and writes records to the console,
+	 * the log-file and the sinks (0: every thread writes its own records).
+	 *
+	 * When output cannot keep up the queue sheds load instead of stalling
+	 * the logging threads: DEBUG records are dropped once it is half full,
+	 * INFO records once it is full. WARN and ERROR records wait for room.
+	 * When the queue has drained, a WARN record reports how many records of
+	 * each level were dropped.
+	 */
+	static Setting<size_t> AsyncQueue;
+
+	/*
+	 * Blocks until the backend has written all queued records
+	 */
+	static void flushQueue();
+
+	/*
+	 * Records of the level that were dropped from a full AsyncQueue
+	 */
+	static unsigned long getDropped(LogLevel);
+
+	/*
+	 * Records go to the registered sinks, each with its own level and layout.
+	 * As long as none are registered, records go to the console and (with
+	 * LogToFile) to LogFileName as configured by the settings above.
+	 */
+	static void addSink(const cv::Ptr<LogSink> &);
+	static void removeSink(const cv::Ptr<LogSink> &);
+	static void clearSinks();
+	static std::shared_ptr<const SinkList> getSinks();
+
+	/*
+	 * Flushes the sinks (LogSink::flush), which also happens at exit after
+	 * the queued records are written
+	 */
+	static void flushSinks();
+
+	static const char* const Color_RED;
+	static const char* const Color_GREEN;
+	static const char* const Color_BLUE;
+	static const char* const Color_YELLOW;
+	static const char* const Color_CYAN;
+	static const char* const Color_RESET;
+
+private:
+	struct Stream
+	{
+		Stream(LogLevel l, bool shared = false) :
+				log_level(l), line(0), time(), message_offset(0), trace(false), trace_start(0), trace_duration(0),
+						trace_depth(0), repeat_summary(false), site_state(shared ? SITE_DISABLED : SITE_DEFAULT), shared(
+						shared), thread(0)
 		{
 		}
 
 		const LogLevel log_level;
-		const std::string &log_filename;
-		std::ofstream file_buffer;
 
-		std::stringstream buffer;
+		MessageBuffer buffer;
+
+		// record meta data, the message starts after the text prefix
+		std::string file;
+		int line;
+		timeval time;
+		size_t message_offset;
+
+		// fields kept apart from the message (see operator<<(const Field<T>&))
+		std::string fields_text;
+		std::string fields_json;
+
+		// timing of a LogScope, for LAYOUT_TRACE
+		bool trace;
+		std::string trace_name; // copied, the backend may write it after the scope has gone
+		int64_t trace_start;
+		int64_t trace_duration;
+		int trace_depth;
+
+		// reports repeats collapsed by coalesce(), is not coalesced itself
+		bool repeat_summary;
+
+		// SiteState of the CVLog statement
+		int site_state;
+
+		// record of the disabled call sites of a thread, see disabled()
+		bool shared;
+
+		// logging thread, when the record is written by the backend
+		long thread;
+
+		// matrices formatted by the backend, at their offset in the buffer
+		std::vector<std::pair<size_t, cv::Mat> > deferred;
 
 	}*_stream;
 
-	const LogFormat _output_format;
+	struct Backend;
 
-	const bool _quiet;
-	const bool _debug;
-	const bool _fixed;
-	const bool _flush;
-	const bool _color;
+	/*
+	 * Repeats of the last record of a thread that coalesce() held back, and
+	 * the thread that reports them once their window has passed
+	 */
+	struct Repeated;
+	struct Repeats;
+	struct RepeatWriter;
 
-	const size_t _precision;
-	const size_t _reference_width;
+	static Repeats& getRepeats();
 
-	size_t _size;
+	const Config* const _config;
 
-	bool _log_to_file;
-	std::string _log_file_name;
+	size_t _size;
 
 	std::vector<size_t> _channel_widths;
+	size_t _overflow; // widest value printed since reset, see StableLayout
+	const TextCells* _cells; // text of the matrix row being printed, if any
+	size_t _cell;
 	bool _singular;
 	int _matrix_type;
 	int _dimension;
 	int _dimensions;
+	int _deltas; // Logger::delta values in this record so far
+
+	/*
+	 * Takes over a record that was queued for the backend, which holds its
+	 * snapshot until it is written. Entering the current one balances the
+	 * destructor.
+	 */
+	Logger(Stream* stream, const Config* config) :
+			_stream(stream), _config(config), _size(_config->size), _overflow(0), _cells(NULL), _cell(0), _singular(true),
+					_matrix_type(0), _dimension(0), _dimensions(0), _deltas(0)
+	{
+		enterConfig();
+	}
 
-	typedef std::vector<std::pair<int, char*> > ImageTSMap;
-	static const ImageTSMap ImageTypeStringMapping;
-	static const ImageTSMap ImagePrimitiveStringMapping;
-	static const std::vector<std::pair<int, char*> > initTypeStringMapping();
-	static const std::vector<std::pair<int, char*> > initPrimitiveStringMapping();
-	static const char* getMatDepthFromCode(int);
-	static const char* getMatPrimitiveFromCode(int);
+	/*
+	 * Logger of the disabled call sites of a thread, which holds no snapshot
+	 */
+	explicit Logger(Stream* stream) :
+			_stream(stream), _config(getDefaultConfig()), _size(_config->size), _overflow(0), _cells(NULL), _cell(0),
+					_singular(true), _matrix_type(0), _dimension(0), _dimensions(0), _deltas(0)
+	{
+	}
+
+	/*
+	 * Stamps the record and writes the text prefix: time, file:line, level and
+	 * the rendered LogContext
+	 */
+	void begin(const std::string &file, int line, const std::string &context_text, const std::string &context_json);
+
+	/*
+	 * Empties the record of the disabled call sites, see disabled()
+	 */
+	void discard()
+	{
+		_stream->buffer.truncate(0);
+		_stream->fields_text.clear();
+		_stream->fields_json.clear();
+		_stream->deferred.clear();
+	}
+
+	/*
+	 * Run-time view on the channels of one matrix element, used for matrices
+	 * that have more channels than the cv::Vec printers are instantiated for
+	 */
+	template<typename T>
+	struct Channels
+	{
+		const T* val;
+		int count;
+	};
+
+	template<typename E>
+	struct MatElement
+	{
+		static E get(const cv::Mat &m, int y, int x)
+		{
+			return m.at<E>(y, x);
+		}
+	};
+
+	template<typename T>
+	struct MatElement<Channels<T> >
+	{
+		static Channels<T> get(const cv::Mat &m, int y, int x)
+		{
+			Channels<T> element = { m.ptr<T>(y) + x * m.channels(), m.channels() };
+			return element;
+		}
+	};
+
+	/*
+	 * Compile-time mapping of (depth, channels) onto the element type the matrix
+	 * is printed with: the primitive for 1 channel, a cv::Vec for up to
+	 * MatVecChannels and a run-time Channels view for anything wider (0)
+	 */
+	template<int depth> struct MatPrimitive;
+
+	/*
+	 * Primitive type of a matrix element, for converting rows in bulk
+	 */
+	template<typename E>
+	struct CellPrimitive
+	{
+		typedef E type;
+	};
+
+	template<typename T, int c>
+	struct CellPrimitive<cv::Vec<T, c> >
+	{
+		typedef T type;
+	};
+
+	template<typename T>
+	struct CellPrimitive<Channels<T> >
+	{
+		typedef T type;
+	};
+
+	template<int depth, int channels>
+	struct MatElementType
+	{
+		typedef cv::Vec<typename MatPrimitive<depth>::type, channels> type;
+	};
+
+	template<int depth>
+	struct MatElementType<depth, 1>
+	{
+		typedef typename MatPrimitive<depth>::type type;
+	};
+
+	template<int depth>
+	struct MatElementType<depth, 0>
+	{
+		typedef Channels<typename MatPrimitive<depth>::type> type;
+	};
+
+	enum
+	{
+		MatDepths = CV_64F + 1, MatVecChannels = 4
+	};
+
+	typedef Logger& (Logger::*MatPrinter)(const cv::Mat&);
+	static const MatPrinter MatPrinters[MatDepths][MatVecChannels + 1];
+
+	static const char* const MatTypeNames[CV_DEPTH_MAX][MatVecChannels];
+	static const char* const MatPrimitiveNames[CV_DEPTH_MAX][MatVecChannels];
+	static int getLayouts(const Config &);
+	static std::mutex& getConfigMutex();
+	static const Config* getDefaultConfig();
+	static void publish(const Config &);
+
+	/*
+	 * Re-evaluates the state of every call site for the settings, called by
+	 * publish()
+	 */
+	static void updateSites(const Config &);
+
+	/*
+	 * A thread announces the snapshot it reads, so that it is not freed
+	 * under it. Loggers enter and leave the snapshot, nested loggers of a
+	 * thread share the outermost one; pinConfig() is for a single read.
+	 * Retired snapshots that nobody holds are freed by reclaimConfigs().
+	 */
+	static const Config* enterConfig();
+	static void leaveConfig();
+	static const Config* pinConfig();
+	static void unpinConfig();
+	static void reclaimConfigs();
+
+	/*
+	 * State of the CVLog call site this thread is creating a record for
+	 */
+	static int& siteState()
+	{
+		static thread_local int state = SITE_DEFAULT;
+		return state;
+	}
+
+	/*
+	 * Identifies matrices that share column widths in StableLayout
+	 */
+	struct LayoutKey
+	{
+		std::string file;
+		int line;
+		int type;
+		int rows;
+		int cols;
+		size_t precision;
+
+		bool operator<(const LayoutKey &) const;
+	};
+
+	typedef std::map<LayoutKey, std::vector<std::vector<size_t> > > LayoutMap;
+
+	static LayoutMap& getStableLayouts();
+	static bool getStableLayout(const LayoutKey &, std::vector<std::vector<size_t> > &);
+	static void putStableLayout(const LayoutKey &, const std::vector<std::vector<size_t> > &);
 
 	static std::string getDatestamp(time_t unix_t = 0);
 	static std::string getTimestamp(time_t unix_t = 0);
 
 	static inline void replaceAll(std::string &, const std::string &, const std::string &);
 
+	/*
+	 * Writes the literal text of a (compile-time validated) format string up to
+	 * the next placeholder and returns the position just after it
+	 */
+	inline const char* writeFormatLiteral(const char* f)
+	{
+		const char* start = f;
+		for (; *f != '\0'; ++f)
+		{
+			if (f[0] == '{' && f[1] == '}')
+			{
+				_stream->buffer.append(start, f - start);
+				return f + 2;
+			}
+			if ((f[0] == '{' && f[1] == '{') || (f[0] == '}' && f[1] == '}'))
+			{
+				_stream->buffer.append(start, f - start + 1);
+				start = ++f + 1;
+			}
+		}
+		_stream->buffer.append(start, f - start);
+		return f;
+	}
+
+	/*
+	 * Whether cvlog::formatter is specialized for T
+	 */
 	template<typename T>
-	inline void doIntegerInputMarkup(const T &input, const std::string &type)
+	struct HasFormatter
 	{
-		if (!_singular)
+		template<typename U>
+		static char test(decltype(formatter<U>::format(std::declval<Logger&>(), std::declval<const U&>()))*);
+
+		template<typename U>
+		static long test(...);
+
+		static const bool value = sizeof(test<T>(0)) == sizeof(char);
+	};
+
+	template<typename T>
+	inline void print(const T& input, std::true_type)
+	{
+		formatter<T>::format(*this, input);
+	}
+
+	template<typename T>
+	void print(const T& input, std::false_type)
+	{
+		std::stringstream buffer;
+		buffer << input;
+		*this << buffer.str().c_str();
+	}
+
+	inline void formatNext(const char* f)
+	{
+		writeFormatLiteral(f);
+	}
+
+	template<typename T, typename ... Args>
+	inline void formatNext(const char* f, T& first, Args&... rest)
+	{
+		f = writeFormatLiteral(f);
+		*this << first;
+		formatNext(f, rest...);
+	}
+
+	/*
+	 * Rows of these types are converted to text by TextCells, other
+	 * element types are printed one value at a time
+	 */
+	template<typename T>
+	static bool formatCells(TextCells &, const T*, size_t, size_t)
+	{
+		return false;
+	}
+
+	static bool formatCells(TextCells &cells, const uchar* values, size_t count, size_t)
+	{
+		return cells.format(values, count);
+	}
+
+	static bool formatCells(TextCells &cells, const schar* values, size_t count, size_t)
+	{
+		return cells.format(values, count);
+	}
+
+	static bool formatCells(TextCells &cells, const ushort* values, size_t count, size_t)
+	{
+		return cells.format(values, count);
+	}
+
+	static bool formatCells(TextCells &cells, const short* values, size_t count, size_t)
+	{
+		return cells.format(values, count);
+	}
+
+	static bool formatCells(TextCells &cells, const int* values, size_t count, size_t)
+	{
+		return cells.format(values, count);
+	}
+
+	static bool formatCells(TextCells &cells, const float* values, size_t count, size_t precision)
+	{
+		return precision <= 9 && cells.format(values, count, (int) precision);
+	}
+
+	static TextCells& getTextCells()
+	{
+		static thread_local TextCells cells;
+		return cells;
+	}
+
+	/*
+	 * Text of the next value if printMatrix converted its row in bulk
+	 */
+	inline bool getCell(const char* &text, size_t &length)
+	{
+		return _cells != NULL && _cells->get(_cell++, text, length);
+	}
+
+	inline void appendPadded(const char* text, size_t length)
+	{
+		static const char Blanks[] = "                                ";
+		for (size_t pad = _size > length ? _size - length : 0; pad > 0;)
 		{
-			char buffer[11];
-			sprintf(buffer, type.c_str(), input);
+			const size_t blanks = MIN(pad, sizeof(Blanks) - 1);
+			_stream->buffer.append(Blanks, blanks);
+			pad -= blanks;
+		}
+		_stream->buffer.append(text, length);
+	}
 
-			std::string space;
-			if (_size > 0) space = std::string(_size - std::string(buffer).length(), ' ');
+	template<typename T>
+	inline void doIntegerInputMarkup(const T &input, const char* type)
+	{
+		const char* text;
+		size_t length;
+		char buffer[24];
+		if (!getCell(text, length))
+		{
+			length = sprintf(buffer, type, input);
+			text = buffer;
+		}
 
-			*this << space << buffer;
+		if (!_singular)
+		{
+			if (length > _overflow) _overflow = length;
+			appendPadded(text, length);
 		}
 		else
 		{
-			char buffer[11];
-			sprintf(buffer, type.c_str(), input);
-
-			*this << buffer;
+			_stream->buffer.append(text, length);
 		}
 	}
 
 	template<typename T>
-	inline void doRealInputMarkup(const T &input, const std::string &type)
+	inline void doRealInputMarkup(const T &input, const char* type)
 	{
-		if (!_singular)
+		const char* text;
+		size_t length;
+		if (getCell(text, length) && !_singular && input != 0.f)
+		{
+			const size_t width = MAX(_size, length);
+			if (width > _overflow) _overflow = width;
+			appendPadded(text, length);
+		}
+		else if (!_singular)
 		{
 			if (input != 0.f)
 			{
-				*this << getRealInputMarkUp(input, "f");
+				const std::string markup = getRealInputMarkUp(input, "f");
+				if (markup.length() > _overflow) _overflow = markup.length();
+				*this << markup;
 			}
 			else
 			{
-				std::string space(_size - 1, ' ');
+				std::string space(_size > 1 ? _size - 1 : 0, ' ');
 				*this << space << "0";
 			}
 		}
@@ -167,46 +833,39 @@ private:
 	template<typename T>
 	inline std::string getRealInputMarkUp(const T &input, const std::string &type)
 	{
-		char buffer[256];
-		std::stringstream layout;
-		layout << "%" << (int) _size << "." << (int) _precision << type;
-		sprintf(buffer, layout.str().c_str(), input);
+		char layout[16], buffer[256];
+		snprintf(layout, sizeof(layout), "%%*.*%s", type.c_str());
+		snprintf(buffer, sizeof(buffer), layout, (int) _size, (int) _config->precision, input);
 		return buffer;
 	}
 
 	std::string getDigitWidth(double mVal)
 	{
-		std::stringstream layout, ssize;
-		layout << "%0." << (int) _precision << "f";
-
 		if (mVal != 0.f)
 		{
 			char buffer[256];
-			sprintf(buffer, layout.str().c_str(), mVal);
+			snprintf(buffer, sizeof(buffer), "%0.*f", (int) _config->precision, mVal);
 
-			ssize << buffer;
+			return buffer;
 		}
 		else
 		{
-			ssize << "0";
+			return "0";
 		}
-
-		return ssize.str();
 	}
 
-	template<typename T, int c>
-	std::vector<size_t> getValueWidth(const cv::Vec<T, c> &v, const cv::Mat &m)
+	template<typename T>
+	std::vector<size_t> getValueWidth(const Channels<T> &v, const cv::Mat &m)
 	{
 		std::vector<size_t> widths;
 
-		for (int i = 0; i < m.channels(); ++i)
+		for (int i = 0; i < v.count; ++i)
 		{
 			T value = 0;
 			cv::Mat channel_vals;
 			for (int r = 0; r < m.rows; ++r)
 			{
-				cv::Vec<T, c> v = m.at<cv::Vec<T, c> >(0, r);
-				value = v[i];
+				value = m.ptr<T>(r)[i];
 				channel_vals.push_back(value);
 			}
 
@@ -218,6 +877,13 @@ private:
 		return widths;
 	}
 
+	template<typename T, int c>
+	std::vector<size_t> getValueWidth(const cv::Vec<T, c> &v, const cv::Mat &m)
+	{
+		Channels<T> channels = { v.val, c };
+		return getValueWidth(channels, m);
+	}
+
 	std::vector<size_t> getValueWidth(const double &value, const cv::Mat &m)
 	{
 		double minVal = INFINITY, maxVal = -INFINITY;
@@ -254,130 +920,34 @@ private:
 		return std::vector<size_t>(1, MAX(ssize_min.str().length(), ssize_max.str().length()));
 	}
 
-	template<typename T>
-	std::vector<size_t> getValueWidth(const T &value, const cv::Mat &m)
+	std::vector<size_t> getValueWidth(const schar &value, const cv::Mat &m)
 	{
 		double minVal = INFINITY, maxVal = -INFINITY;
 		cv::minMaxIdx(m, &minVal, &maxVal);
 
 		std::stringstream ssize_min, ssize_max;
-		ssize_min << (T) minVal;
-		ssize_max << (T) maxVal;
+		ssize_min << (int) minVal;
+		ssize_max << (int) maxVal;
 
 		return std::vector<size_t>(1, MAX(ssize_min.str().length(), ssize_max.str().length()));
 	}
 
-public:
-	inline Logger(LogLevel l, const std::string f = LogFileName) :
-			_stream(new Stream(l, f)), _output_format(OutputFormat), _quiet(Quiet), _debug(Debug), _fixed(Fixed), _flush(
-					Flush), _color(Color), _precision(Precision), _reference_width(ReferenceWidth), _size(Size), _log_to_file(
-					LogToFile), _log_file_name(LogFileName), _singular(true), _matrix_type(0), _dimension(0), _dimensions(0)
-	{
-		if (isLogToFile())
-		{
-			_stream->file_buffer.open(_log_file_name.c_str(), std::ofstream::app);
-			if (!_stream->file_buffer.is_open())
-			{
-				std::string path = _log_file_name;
-				path = path.substr(0, path.find_last_of("\\/"));
-				boost::filesystem::create_directories(path);
-				_stream->file_buffer.open(_log_file_name.c_str(), std::ofstream::app);
-				assert(_stream->file_buffer.is_open());
-			}
-		}
-	}
-
-	inline ~Logger()
-	{
-		output();
-
-		if (isLogToFile())
-		{
-			write();
-			_stream->file_buffer.close();
-		}
-		delete _stream;
-	}
-
-	static Logger create(const Logger::LogLevel, const std::string = "", const int = 0);
-
-	static std::string getMicrotime(time_t unix_t = 0);
-	static std::string getStrippedFilename(const std::string &);
-	static std::string getLevelDescr(LogLevel);
-
-	template<typename T>
-	Logger& operator<<(const T& input)
-	{
-		std::stringstream buffer;
-		buffer << input;
-		*this << buffer.str().c_str();
-		return *this;
-	}
-
-	template<typename T, typename U>
-	Logger& operator<<(const std::pair<T, U>& input)
-	{
-		_singular = true;
-		*this << input.first << ":" << input.second;
-		return *this;
-	}
-
-	template<typename T, typename U>
-	Logger& operator<<(const std::map<T, U>& input)
-	{
-		_singular = true;
-		typename std::map<T, U>::const_iterator pair = input.begin();
-		*this << "[";
-		for (size_t i = 0; i < input.size(); i++, ++pair)
-			*this << *pair << ", ";
-		*this << "]";
-
-		return *this;
-	}
-
 	template<typename T>
-	Logger& operator<<(const std::set<T>& input)
-	{
-		_singular = true;
-		typename std::set<T>::const_iterator iter = input.begin();
-		*this << "(" << input.size() << "):";
-
-		for (size_t i = 0; i < input.size(); i++, ++iter)
-			*this << *iter << ", ";
-
-		return *this;
-	}
-
-	template<typename T>
-	Logger& operator<<(const std::vector<T>& input)
-	{
-		_singular = true;
-		typename std::vector<T>::const_iterator iter = input.begin();
-		*this << "(" << input.size() << "):";
-
-		for (size_t i = 0; i < input.size(); i++, ++iter)
-			*this << *iter << ", ";
-
-		return *this;
-	}
-
-	template<typename T>
-	Logger& operator<<(const std::deque<T>& input)
+	std::vector<size_t> getValueWidth(const T &value, const cv::Mat &m)
 	{
-		_singular = true;
-		typename std::deque<T>::const_iterator iter = input.begin();
-		*this << "(" << input.size() << "):";
+		double minVal = INFINITY, maxVal = -INFINITY;
+		cv::minMaxIdx(m, &minVal, &maxVal);
 
-		for (size_t i = 0; i < input.size(); i++, ++iter)
-			*this << *iter << ",";
+		std::stringstream ssize_min, ssize_max;
+		ssize_min << (T) minVal;
+		ssize_max << (T) maxVal;
 
-		return *this;
+		return std::vector<size_t>(1, MAX(ssize_min.str().length(), ssize_max.str().length()));
 	}
 
-	template<typename T>
-	Logger& operator<<(cv::Mat_<T>& matrix)
+	template<typename E>
+	Logger& printMatrix(const cv::Mat &t_m)
 	{
-		cv::Mat t_m = matrix;
 
 		if (t_m.dims < 3)
 		{
@@ -386,7 +956,7 @@ public:
 			size_t s = _size;
 			_size = 0;
 
-			switch (_output_format)
+			switch (_config->output_format)
 			{
 				case FORMAT_OPENCV:
 					*this << "cv::Mat var = (cv::Mat_<" << getMatPrimitiveFromCode(_matrix_type) << " >";
@@ -397,17 +967,32 @@ public:
 					break;
 				case FORMAT_DEFAULT:
 				default:
-					*this << getMatDepthFromCode(matrix.type()) << "(" << t_m.rows << "x" << t_m.cols << ")\n";
+					*this << getMatDepthFromCode(t_m.type()) << "(" << t_m.rows << "x" << t_m.cols << ")\n";
 					break;
 			}
 
 			_size = s;
 
 			std::vector<std::vector<size_t> > size;
+			TextCells &cells = getTextCells();
+
+			// column widths of the last matrix of this type and shape from this call site
+			const bool stable = _config->stable_layout;
+			LayoutKey key;
+			if (stable)
+			{
+				key.file = _stream->file;
+				key.line = _stream->line;
+				key.type = t_m.type();
+				key.rows = t_m.rows;
+				key.cols = t_m.cols;
+				key.precision = _config->precision;
+				getStableLayout(key, size);
+			}
 
 			for (int y = 0; y < t_m.rows; y++)
 			{
-				switch (_output_format)
+				switch (_config->output_format)
 				{
 					case FORMAT_MATLAB:
 					{
@@ -432,20 +1017,27 @@ public:
 						break;
 				}
 
+				typedef typename CellPrimitive<E>::type P;
+				const bool formatted = formatCells(cells, t_m.ptr<P>(y), (size_t) t_m.cols * t_m.channels(),
+						_config->precision);
+
 				for (int x = 0; x < t_m.cols; x++)
 				{
-					if (y == 0)
+					if (y == 0 && size.size() < (size_t) t_m.cols)
 					{
 						cv::Mat row = t_m.col(x).clone();
-						T& wp = matrix(cv::Point(x, y));
+						E wp = MatElement<E>::get(t_m, y, x);
 						size.push_back(getValueWidth(wp, row));
 					}
 
 					_channel_widths = size.at(x);
 					_size = _channel_widths.front();
-					T& point = matrix(cv::Point(x, y));
+					_overflow = 0;
+					_cells = formatted ? &cells : NULL;
+					_cell = (size_t) x * t_m.channels();
+					E point = MatElement<E>::get(t_m, y, x);
 
-					switch (_output_format)
+					switch (_config->output_format)
 					{
 						case FORMAT_OPENCV:
 						{
@@ -490,9 +1082,17 @@ public:
 							*this << point << " ";
 							break;
 					}
+
+					if (stable)
+					{
+						if (_channel_widths.size() == 1 && _overflow > _channel_widths.front())
+							_channel_widths.front() = _overflow;
+						size[x] = _channel_widths;
+					}
 				}
+				_cells = NULL;
 
-				switch (_output_format)
+				switch (_config->output_format)
 				{
 					case FORMAT_OPENCV:
 					{
@@ -516,7 +1116,7 @@ public:
 				}
 			}
 
-			switch (_output_format)
+			switch (_config->output_format)
 			{
 				case FORMAT_OPENCV:
 					*this << ");\n";
@@ -537,6 +1137,8 @@ public:
 					break;
 			}
 
+			if (stable) putStableLayout(key, size);
+
 			_size = s;
 		}
 		else
@@ -553,7 +1155,7 @@ public:
 				else
 					*this << "x";
 			}
-			switch (_output_format)
+			switch (_config->output_format)
 			{
 				case FORMAT_MATLAB:
 					*this << "reshape([ ";
@@ -570,7 +1172,7 @@ public:
 				_dimension = c;
 				size_t s = _size;
 				_size = 0;
-				switch (_output_format)
+				switch (_config->output_format)
 				{
 					case FORMAT_OPENCV:
 						break;
@@ -606,7 +1208,7 @@ public:
 
 				*this << pdmin;
 
-				switch (_output_format)
+				switch (_config->output_format)
 				{
 					default:
 						if (c != t_m.size[d] - 1 && d != t_m.dims - 1) *this << "\n";
@@ -615,7 +1217,7 @@ public:
 			}
 
 			_size = 0;
-			switch (_output_format)
+			switch (_config->output_format)
 			{
 				case FORMAT_MATLAB:
 					*this << ",[";
@@ -633,17 +1235,11 @@ public:
 	}
 
 	template<typename T>
-	Logger& operator<<(const cv::Ptr<T>& p_mat)
-	{
-		*this << *p_mat;
-		return *this;
-	}
-
-	template<typename T, int c>
-	Logger& operator<<(cv::Vec<T, c>& vector)
+	Logger& operator<<(const Channels<T>& channels)
 	{
-		T* val = vector.val;
-		switch (_output_format)
+		const T* val = channels.val;
+		const int c = channels.count;
+		switch (_config->output_format)
 		{
 			case FORMAT_OPENCV:
 				*this << getMatPrimitiveFromCode(_matrix_type) << "(";
@@ -659,8 +1255,10 @@ public:
 		}
 		for (int i = 0; i < c; i++)
 		{
-			_size = _channel_widths.at(i);
-			switch (_output_format)
+			// a vector of its own has no column widths, it takes its natural width
+			_size = _singular ? 0 : _channel_widths.at(i);
+			_overflow = 0;
+			switch (_config->output_format)
 			{
 				case FORMAT_MATLAB:
 					*this << val[i] << " ";
@@ -677,8 +1275,11 @@ public:
 					if (i < c - 1) *this << ";";
 					break;
 			}
+
+			// a value wider than its (stable layout) column widens it
+			if (!_singular && _overflow > _channel_widths[i]) _channel_widths[i] = _overflow;
 		}
-		switch (_output_format)
+		switch (_config->output_format)
 		{
 			case FORMAT_C:
 			case FORMAT_CSV:
@@ -694,16 +1295,342 @@ public:
 		return *this;
 	}
 
+public:
+	/*
+	 * The file name argument is ignored, records go to LogFileName
+	 */
+	inline Logger(LogLevel l, const std::string & = std::string()) :
+			_stream(new Stream(l)), _config(enterConfig()), _size(_config->size), _overflow(0), _cells(NULL), _cell(0),
+					_singular(true), _matrix_type(0), _dimension(0), _dimensions(0), _deltas(0)
+	{
+	}
+
+	/*
+	 * The copy takes the record over and the original writes nothing, so a
+	 * record can be handed on from a temporary (see CVLog)
+	 */
+	inline Logger(const Logger &other) :
+			_stream(other._stream), _config(other._config), _size(other._size), _channel_widths(other._channel_widths),
+					_overflow(other._overflow), _cells(other._cells), _cell(other._cell), _singular(other._singular),
+					_matrix_type(other._matrix_type), _dimension(other._dimension), _dimensions(other._dimensions),
+					_deltas(other._deltas)
+	{
+		// the record of the disabled call sites stays with the thread
+		if (_stream != NULL && _stream->shared) return;
+
+		const_cast<Logger&>(other)._stream = NULL;
+		enterConfig();
+	}
+
+	inline ~Logger()
+	{
+		// handed on to a copy
+		if (_stream == NULL)
+		{
+			leaveConfig();
+			return;
+		}
+
+		// switched off, nothing is kept
+		if (_stream->site_state == SITE_DISABLED)
+		{
+			if (_stream->shared)
+			{
+				discard();
+				return;
+			}
+
+			delete _stream;
+			leaveConfig();
+			return;
+		}
+
+		if (CrashRing::isEnabled()) capture();
+
+		if (_config->coalesce_window > 0 && coalesce())
+		{
+			// a repeat, reported later
+		}
+		else if (_config->async_queue > 0)
+		{
+			// the backend owns the stream from here
+			post();
+			leaveConfig();
+			return;
+		}
+		else
+		{
+			deliver();
+		}
+		delete _stream;
+		leaveConfig();
+	}
+
+	static Logger create(const Logger::LogLevel, const std::string = "", const int = 0, int site_state = SITE_DEFAULT);
+
+	/*
+	 * The record of the disabled call sites of this thread, made once. What
+	 * is logged to it is dropped when a logger that took it over goes.
+	 */
+	static Logger& disabled()
+	{
+		static thread_local Stream stream(LOG_DEBUG, true);
+		static thread_local Logger logger(&stream);
+		return logger;
+	}
+
+	/*
+	 * Used by CVLog to make both branches lvalues of the same type
+	 */
+	Logger& self()
+	{
+		return *this;
+	}
+
+	/*
+	 * Writes the repeat count of records this thread is still collapsing
+	 * (see CoalesceWindow); otherwise that happens with its next record,
+	 * when the window has passed or when the thread exits
+	 */
+	static void flushRepeats();
+
+	static std::string getMicrotime(time_t unix_t = 0);
+	static std::string getStrippedFilename(const std::string &);
+	static std::string getLevelDescr(LogLevel);
+	static long getThreadId();
+	static int getSeverity(LogLevel);
+
+	static const char* getMatDepthFromCode(int);
+	static const char* getMatPrimitiveFromCode(int);
+
+	/*
+	 * CVLog(INFO) << "tracking" << Logger::field("roi", rect);
+	 */
+	template<typename T>
+	static Field<T> field(const char* key, const T& value)
+	{
+		Field<T> f = { key, value };
+		return f;
+	}
+
+	/*
+	 * CVLog(DEBUG) << "H: " << Logger::delta(homography, 1e-6);
+	 * The first time in full, after that only the elements that changed by
+	 * more than the tolerance since they were last logged, and to or from
+	 * NaN. In full again when the type or shape changes.
+	 */
+	static Delta delta(const cv::Mat& mat, double tolerance = 0, const char* tag = NULL)
+	{
+		Delta d = { mat, tolerance, tag };
+		return d;
+	}
+
+	static void clearDeltas();
+
+	/*
+	 * 8-bit image written to a thumbnail file by the ImageWriter, of which
+	 * only the name and a summary end up in the record
+	 */
+	struct Image
+	{
+		const cv::Mat& mat;
+		const char* name;
+	};
+
+	/*
+	 * CVLog(DEBUG) << "input: " << Logger::image(frame, "input");
+	 * Images that are not CV_8UC1, CV_8UC3 or CV_8UC4 are printed as text
+	 */
+	static Image image(const cv::Mat& mat, const char* name = NULL)
+	{
+		Image i = { mat, name };
+		return i;
+	}
+
+	/*
+	 * Matrix formatted by the backend instead of the logging thread, see ref()
+	 */
+	struct MatRef
+	{
+		const cv::Mat& mat;
+		bool snapshot;
+	};
+
+	/*
+	 * CVLog(DEBUG) << "H: " << Logger::ref(homography);
+	 * With AsyncQueue the record keeps a reference to the matrix data, which
+	 * the caller must not write to until the backend has formatted it. With
+	 * snapshot the record keeps a copy of the data instead, which costs a
+	 * memcpy but no formatting. The crash ring keeps the record without the
+	 * matrix. Without AsyncQueue the matrix is printed right away.
+	 */
+	static MatRef ref(const cv::Mat& mat, bool snapshot = false)
+	{
+		MatRef r = { mat, snapshot };
+		return r;
+	}
+
+	template<typename T>
+	Logger& operator<<(const Field<T>& input)
+	{
+		const bool text = (_config->layouts & (1 << LAYOUT_TEXT)) != 0;
+		const bool json = (_config->layouts & (1 << LAYOUT_JSON)) != 0;
+
+		if (json)
+		{
+			JsonWriter writer(_stream->fields_json);
+			writer.raw(",", 1).key(input.key).value(input.value);
+		}
+
+		if (text && json)
+		{
+			// move the text out of the message so the JSON message does not repeat the field
+			const size_t message_size = _stream->buffer.size();
+			*this << " " << input.key << "=" << input.value;
+			_stream->fields_text.append(_stream->buffer.data() + message_size, _stream->buffer.size() - message_size);
+			_stream->buffer.truncate(message_size);
+		}
+		else if (text)
+		{
+			*this << " " << input.key << "=" << input.value;
+		}
+
+		return *this;
+	}
+
+	template<typename F>
+	Logger& operator<<(const Lazy<F>& input)
+	{
+		if (isEnabled()) *this << input.function();
+		return *this;
+	}
+
+	/*
+	 * Number of {} placeholders in a format string, or -1 if it contains a
+	 * brace that is neither part of a placeholder nor escaped
+	 */
+	static constexpr int countFormatArgs(const char* f, int n = 0)
+	{
+		return *f == '\0' ? n :
+				(f[0] == '{' && f[1] == '{') || (f[0] == '}' && f[1] == '}') ? countFormatArgs(f + 2, n) :
+				f[0] == '{' && f[1] == '}' ? countFormatArgs(f + 2, n + 1) :
+				f[0] == '{' || f[0] == '}' ? -1 : countFormatArgs(f + 1, n);
+	}
+
+	template<int N, typename ... Args>
+	Logger& format(const char* f, Args&&... args)
+	{
+		static_assert(N >= 0, "CVLogF: unbalanced brace in format string, use {{ or }} for a literal brace");
+		static_assert(N == sizeof...(Args), "CVLogF: number of {} placeholders does not match the number of arguments");
+
+		formatNext(f, args...);
+		return *this;
+	}
+
+	template<typename T>
+	Logger& operator<<(const T& input)
+	{
+		print(input, std::integral_constant<bool, HasFormatter<T>::value>());
+		return *this;
+	}
+
+	template<typename T, typename U>
+	Logger& operator<<(const std::pair<T, U>& input)
+	{
+		_singular = true;
+		*this << input.first << ":" << input.second;
+		return *this;
+	}
+
+	template<typename T, typename U>
+	Logger& operator<<(const std::map<T, U>& input)
+	{
+		_singular = true;
+		typename std::map<T, U>::const_iterator pair = input.begin();
+		*this << "[";
+		for (size_t i = 0; i < input.size(); i++, ++pair)
+			*this << *pair << ", ";
+		*this << "]";
+
+		return *this;
+	}
+
+	template<typename T>
+	Logger& operator<<(const std::set<T>& input)
+	{
+		_singular = true;
+		typename std::set<T>::const_iterator iter = input.begin();
+		*this << "(" << input.size() << "):";
+
+		for (size_t i = 0; i < input.size(); i++, ++iter)
+			*this << *iter << ", ";
+
+		return *this;
+	}
+
+	template<typename T>
+	Logger& operator<<(const std::vector<T>& input)
+	{
+		_singular = true;
+		typename std::vector<T>::const_iterator iter = input.begin();
+		*this << "(" << input.size() << "):";
+
+		for (size_t i = 0; i < input.size(); i++, ++iter)
+			*this << *iter << ", ";
+
+		return *this;
+	}
+
+	template<typename T>
+	Logger& operator<<(const std::deque<T>& input)
+	{
+		_singular = true;
+		typename std::deque<T>::const_iterator iter = input.begin();
+		*this << "(" << input.size() << "):";
+
+		for (size_t i = 0; i < input.size(); i++, ++iter)
+			*this << *iter << ",";
+
+		return *this;
+	}
+
+	template<typename T>
+	Logger& operator<<(const cv::Ptr<T>& p_mat)
+	{
+		*this << *p_mat;
+		return *this;
+	}
+
+	template<typename T>
+	Logger& operator<<(const cv::Mat_<T>& matrix)
+	{
+		return *this << static_cast<const cv::Mat&>(matrix);
+	}
+
+	template<typename T, int c>
+	Logger& operator<<(const cv::Vec<T, c>& vector)
+	{
+		if (_singular) _matrix_type = cv::DataType<cv::Vec<T, c> >::type;
+		Channels<T> channels = { vector.val, c };
+		return *this << channels;
+	}
+
+	/*
+	 * Scalar and string fast paths, defined inline below the class so that a
+	 * chain of tokens does not call into the shared library once per token
+	 */
 	Logger& operator<<(const char*);
+	Logger& operator<<(const std::string&);
 	Logger& operator<<(uchar);
-	Logger& operator<<(double);
-	Logger& operator<<(float);
-	Logger& operator<<(long);
-	Logger& operator<<(int);
+	Logger& operator<<(schar);
 	Logger& operator<<(short);
 	Logger& operator<<(ushort);
-	Logger& operator<<(bool);
+	Logger& operator<<(int);
 	Logger& operator<<(long unsigned int);
+	Logger& operator<<(long);
+	Logger& operator<<(float);
+	Logger& operator<<(double);
+	Logger& operator<<(bool);
 
 	Logger& operator<<(const cv::Mat&);
 	Logger& operator<<(const cv::Size&);
@@ -711,48 +1638,78 @@ public:
 	Logger& operator<<(const cv::Point&);
 	Logger& operator<<(const cv::Rect&);
 	Logger& operator<<(const cv::Range&);
+	Logger& operator<<(const Delta&);
+	Logger& operator<<(const Image&);
+	Logger& operator<<(const MatRef&);
 
 	void output();
 	void write();
+	void dispatch();
+	void deliver();
+	void post();
+	void formatDeferred();
+	void capture() const;
+	bool coalesce();
+	bool render(LogLayout, std::string &) const;
+	void toText(std::string &) const;
+	void toJson(std::string &) const;
+	void toTrace(std::string &) const;
 
 	bool isFixed() const
 	{
-		return _fixed;
+		return _config->fixed;
 	}
 
 	bool isFlush() const
 	{
-		return _flush;
+		return _config->flush;
 	}
 
 	const std::string& getLogFileName() const
 	{
-		return _log_file_name;
+		return _config->log_file_name;
 	}
 
 	bool isLogToFile() const
 	{
-		return _log_to_file;
+		return _config->log_to_file;
 	}
 
 	LogFormat getOutputFormat() const
 	{
-		return _output_format;
+		return _config->output_format;
+	}
+
+	LogLayout getOutputLayout() const
+	{
+		return _config->output_layout;
 	}
 
 	size_t getPrecision() const
 	{
-		return _precision;
+		return _config->precision;
 	}
 
 	bool isQuiet() const
 	{
-		return _quiet;
+		return _config->quiet;
 	}
 
+	/*
+	 * Whether this record will be written to the console, the log-file or any
+	 * of the sinks
+	 */
+	bool isEnabled() const;
+
+	/*
+	 * Whether a record of the level from a call site in the state would be
+	 * written with the settings
+	 */
+	static bool isWritten(const Config &, LogLevel, int site_state);
+
 	size_t getReferenceWidth() const
 	{
-		return _reference_width;
+		return _config->reference_width;
 	}
 
 	size_t getSize() const
@@ -762,7 +1719,144 @@ public:
 
 	bool isColor() const
 	{
-		return _color;
+		return _config->color;
+	}
+};
+
+/*
+ * With CVLOG_OUT_OF_LINE the fast paths are compiled into the library, as
+ * they were before they were inlined, so that bench/LoggerBench.cpp can
+ * compare the two. The library and the code using it have to agree on it.
+ */
+#if !defined(CVLOG_OUT_OF_LINE) || defined(CVLOG_FAST_PATH_DEFINITIONS)
+#ifdef CVLOG_OUT_OF_LINE
+#define CVLOG_FAST_PATH
+#else
+#define CVLOG_FAST_PATH inline
+#endif
+
+CVLOG_FAST_PATH Logger& Logger::operator<<(const char* input)
+{
+	_stream->buffer.append(input);
+	return *this;
+}
+
+CVLOG_FAST_PATH Logger& Logger::operator<<(const std::string& input)
+{
+	_stream->buffer.append(input);
+	return *this;
+}
+
+/*
+ * Cast unsigned char to int to show it as a number
+ */
+CVLOG_FAST_PATH Logger& Logger::operator<<(uchar input)
+{
+	*this << (int) input;
+	return *this;
+}
+
+/*
+ * Cast signed char to int to show it as a number
+ */
+CVLOG_FAST_PATH Logger& Logger::operator<<(schar input)
+{
+	*this << (int) input;
+	return *this;
+}
+
+CVLOG_FAST_PATH Logger& Logger::operator<<(short input)
+{
+	doIntegerInputMarkup(input, "%d");
+	return *this;
+}
+
+CVLOG_FAST_PATH Logger& Logger::operator<<(ushort input)
+{
+	doIntegerInputMarkup(input, "%u");
+	return *this;
+}
+
+CVLOG_FAST_PATH Logger& Logger::operator<<(int input)
+{
+	doIntegerInputMarkup(input, "%d");
+	return *this;
+}
+
+CVLOG_FAST_PATH Logger& Logger::operator<<(long unsigned int input)
+{
+	doIntegerInputMarkup(input, "%lu");
+	return *this;
+}
+
+CVLOG_FAST_PATH Logger& Logger::operator<<(long input)
+{
+	doIntegerInputMarkup(input, "%ld");
+	return *this;
+}
+
+CVLOG_FAST_PATH Logger& Logger::operator<<(float input)
+{
+	doRealInputMarkup(input, "f");
+	return *this;
+}
+
+CVLOG_FAST_PATH Logger& Logger::operator<<(double input)
+{
+	doRealInputMarkup(input, "f");
+	return *this;
+}
+
+CVLOG_FAST_PATH Logger& Logger::operator<<(bool input)
+{
+	if (input)
+		*this << "true";
+	else
+		*this << "false";
+	return *this;
+}
+
+#undef CVLOG_FAST_PATH
+#endif
+
+template<typename T>
+struct formatter<cv::Point_<T> >
+{
+	static void format(Logger &log, const cv::Point_<T> &point)
+	{
+		log << "(" << point.x << ";" << point.y << ")";
+	}
+};
+
+template<>
+struct formatter<cv::KeyPoint>
+{
+	static void format(Logger &log, const cv::KeyPoint &key_point)
+	{
+		log << key_point.pt << " size:" << key_point.size << " angle:" << key_point.angle << " response:"
+				<< key_point.response << " octave:" << key_point.octave;
+		if (key_point.class_id != -1) log << " class:" << key_point.class_id;
+	}
+};
+
+template<>
+struct formatter<cv::RotatedRect>
+{
+	static void format(Logger &log, const cv::RotatedRect &rect)
+	{
+		log << rect.center << " w:" << rect.size.width << " x h:" << rect.size.height << " angle:" << rect.angle;
+	}
+};
+
+/*
+ * Printed as a matrix, through a header on its elements
+ */
+template<typename T, int m, int n>
+struct formatter<cv::Matx<T, m, n> >
+{
+	static void format(Logger &log, const cv::Matx<T, m, n> &matx)
+	{
+		log << cv::Mat(m, n, cv::DataType<T>::type, (void*) matx.val);
 	}
 };
 
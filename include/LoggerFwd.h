@@ -0,0 +1,38 @@
+/*
+ * LoggerFwd.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef LOGGERFWD_H_
+#define LOGGERFWD_H_
+
+/*
+ * Declarations only, for headers that pass a Logger or hold a LogSink but
+ * do not log themselves. Logger.h pulls in all of OpenCV core; include it
+ * in the source files that use CVLog instead of in widely used headers.
+ */
+namespace nl_uu_science_gmt
+{
+
+class Logger;
+class LogSink;
+class ConsoleSink;
+class FileSink;
+class MemorySink;
+class MmapRingSink;
+class SyslogSink;
+class SocketSink;
+class LogContext;
+class LogScope;
+class CrashRing;
+class ImageWriter;
+
+template<typename T>
+struct formatter;
+
+} /* namespace nl_uu_science_gmt */
+
+namespace cvlog = nl_uu_science_gmt;
+
+#endif /* LOGGERFWD_H_ */
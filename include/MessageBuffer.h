@@ -0,0 +1,90 @@
+/*
+ * MessageBuffer.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef MESSAGEBUFFER_H_
+#define MESSAGEBUFFER_H_
+
+#include <cstring>
+#include <string>
+
+namespace nl_uu_science_gmt
+{
+
+/*
+ * Text of a record under construction.
+ *
+ * Typical lines fit in the inline storage and need no allocation at all.
+ * Longer ones (matrix dumps) grow geometrically into a heap block that is
+ * kept per thread when the record is done, so the next large record on the
+ * same thread starts with room to spare.
+ */
+class MessageBuffer
+{
+public:
+	static const size_t InlineCapacity = 256;
+
+private:
+	char* _data;
+	size_t _size;
+	size_t _capacity;
+	char _inline[InlineCapacity];
+
+	MessageBuffer(const MessageBuffer &);
+	MessageBuffer& operator=(const MessageBuffer &);
+
+	void grow(size_t);
+
+public:
+	MessageBuffer() :
+			_data(_inline), _size(0), _capacity(InlineCapacity)
+	{
+	}
+
+	~MessageBuffer();
+
+	inline void append(const char* input, size_t length)
+	{
+		if (_size + length > _capacity) grow(_size + length);
+		memcpy(_data + _size, input, length);
+		_size += length;
+	}
+
+	inline void append(const char* input)
+	{
+		if (input != NULL) append(input, strlen(input));
+	}
+
+	inline void append(const std::string &input)
+	{
+		append(input.data(), input.length());
+	}
+
+	/*
+	 * Drops everything after the first 'size' characters
+	 */
+	inline void truncate(size_t size)
+	{
+		if (size < _size) _size = size;
+	}
+
+	const char* data() const
+	{
+		return _data;
+	}
+
+	size_t size() const
+	{
+		return _size;
+	}
+
+	std::string str() const
+	{
+		return std::string(_data, _size);
+	}
+};
+
+} /* namespace nl_uu_science_gmt */
+#endif /* MESSAGEBUFFER_H_ */
@@ -0,0 +1,79 @@
+/*
+ * TextCells.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef TEXTCELLS_H_
+#define TEXTCELLS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace nl_uu_science_gmt
+{
+
+/*
+ * Decimal text of a row of matrix values, converted in bulk instead of one
+ * sprintf per value. Each value is right-aligned in a slot of fixed size,
+ * so padding it to a column width is a copy of the slot's tail.
+ *
+ * The text is identical to sprintf with %d or %u for integers, and %.*f
+ * for floats. 8-bit rows use SSE2 or AVX2, whichever the CPU supports. A
+ * float the kernel cannot convert exactly (precision above 9, very large
+ * values, NaN and infinity) gets length 0 and is printed the usual way.
+ */
+class TextCells
+{
+	static std::atomic<bool> _enabled;
+
+	std::vector<char> _text;
+	std::vector<uint8_t> _length;
+	size_t _slot;
+
+	void resize(size_t count, size_t slot);
+
+public:
+	TextCells() :
+			_slot(0)
+	{
+	}
+
+	/*
+	 * Off: every value goes through sprintf, for comparison
+	 */
+	static void setEnabled(bool enabled)
+	{
+		_enabled.store(enabled, std::memory_order_relaxed);
+	}
+
+	static bool isEnabled()
+	{
+		return _enabled.load(std::memory_order_relaxed);
+	}
+
+	/*
+	 * Return false if the row is left to sprintf
+	 */
+	bool format(const unsigned char*, size_t count);
+	bool format(const signed char*, size_t count);
+	bool format(const unsigned short*, size_t count);
+	bool format(const short*, size_t count);
+	bool format(const int*, size_t count);
+	bool format(const float*, size_t count, int precision);
+
+	/*
+	 * Text of the i-th value, or false if it has none
+	 */
+	inline bool get(size_t i, const char* &text, size_t &length) const
+	{
+		length = _length[i];
+		text = &_text[(i + 1) * _slot - length];
+		return length > 0;
+	}
+};
+
+} /* namespace nl_uu_science_gmt */
+#endif /* TEXTCELLS_H_ */
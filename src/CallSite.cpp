@@ -0,0 +1,209 @@
+/*
+ * CallSite.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+#include "Logger.h"
+
+#include <fnmatch.h>
+#include <strings.h>
+#include <cstdlib>
+
+namespace nl_uu_science_gmt
+{
+
+/*
+ * All call sites that have been reached so far, and the module levels.
+ * Sites are static and never unregister.
+ */
+struct CallSiteRegistry
+{
+	struct Rule
+	{
+		std::string pattern;
+		int severity; // least important severity written, OFF above ERROR
+	};
+
+	std::mutex mutex;
+	Logger::CallSite* sites;
+	std::vector<Rule> rules;
+
+	CallSiteRegistry() :
+			sites(NULL)
+	{
+		const char* levels = getenv("CVLOG_LEVELS");
+		if (levels != NULL && !parse(levels, ','))
+			std::cerr << "Invalid CVLOG_LEVELS: " << levels << std::endl;
+	}
+
+	static CallSiteRegistry& get()
+	{
+		static CallSiteRegistry registry;
+		return registry;
+	}
+
+	static int getSeverity(std::string level)
+	{
+		static const char* const Names[] = { "DEBUG", "INFO", "WARN", "ERROR", "OFF" };
+		static const Logger::LogLevel Levels[] = { Logger::LOG_DEBUG, Logger::LOG_INFO, Logger::LOG_WARN,
+				Logger::LOG_ERROR };
+
+		for (int i = 0; i < 5; ++i)
+			if (strcasecmp(level.c_str(), Names[i]) == 0) return i < 4 ? Logger::getSeverity(Levels[i]) : 4;
+		return -1;
+	}
+
+	static std::string trim(const std::string &text)
+	{
+		const size_t start = text.find_first_not_of(" \t\r");
+		if (start == std::string::npos) return std::string();
+		return text.substr(start, text.find_last_not_of(" \t\r") - start + 1);
+	}
+
+	/*
+	 * pattern=LEVEL entries separated by the delimiter, # starts a comment
+	 */
+	bool parse(const std::string &text, char delimiter)
+	{
+		bool valid = true;
+		std::stringstream entries(text);
+		std::string entry;
+		while (std::getline(entries, entry, delimiter))
+		{
+			entry = trim(entry.substr(0, entry.find('#')));
+			if (entry.empty()) continue;
+
+			const size_t is = entry.find('=');
+			const int severity = is == std::string::npos ? -1 : getSeverity(trim(entry.substr(is + 1)));
+			if (severity < 0)
+			{
+				valid = false;
+				continue;
+			}
+
+			Rule rule = { trim(entry.substr(0, is)), severity };
+			rules.push_back(rule);
+		}
+		return valid;
+	}
+
+	/*
+	 * A pattern with a slash is matched against the path, others against the
+	 * base name: __FILE__ is the path the compiler was given, often absolute
+	 */
+	static bool matches(const std::string &pattern, const std::string &path)
+	{
+		const std::string name =
+				pattern.find_first_of("\\/") != std::string::npos ? path : path.substr(path.find_last_of("\\/") + 1);
+		return fnmatch(pattern.c_str(), name.c_str(), 0) == 0;
+	}
+
+	int getLevelState(const Logger::CallSite &site) const
+	{
+		const std::string file = Logger::getStrippedFilename(site._file);
+		for (std::vector<Rule>::const_reverse_iterator rule = rules.rbegin(); rule != rules.rend(); ++rule)
+		{
+			if ((site._module != NULL && fnmatch(rule->pattern.c_str(), site._module, 0) == 0)
+					|| matches(rule->pattern, file))
+			{
+				return Logger::getSeverity(site._level) >= rule->severity ?
+						Logger::SITE_ENABLED : Logger::SITE_DISABLED;
+			}
+		}
+		return Logger::SITE_DEFAULT;
+	}
+
+	/*
+	 * The module level, or disabled when the settings would not write the
+	 * records of the site. The crash ring keeps records that are not written,
+	 * so while it records only the module levels disable a site.
+	 */
+	int getState(const Logger::CallSite &site, const Logger::Config &config) const
+	{
+		const int state = getLevelState(site);
+		if (!CrashRing::isEnabled() && !Logger::isWritten(config, site._level, state)) return Logger::SITE_DISABLED;
+		return state;
+	}
+
+	void update(const Logger::Config &config)
+	{
+		for (Logger::CallSite* site = sites; site != NULL; site = site->_next)
+			site->_state.store(getState(*site, config), std::memory_order_relaxed);
+	}
+
+	/*
+	 * With the mutex held: a snapshot published meanwhile updates the sites
+	 * again after this
+	 */
+	void update()
+	{
+		update(*Logger::pinConfig());
+		Logger::unpinConfig();
+	}
+};
+
+Logger::CallSite::CallSite(LogLevel level, const char* file, int line, const char* module) :
+		_level(level), _file(file), _line(line), _module(module), _state(SITE_DEFAULT), _next(NULL)
+{
+	CallSiteRegistry &registry = CallSiteRegistry::get();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	_state.store(registry.getState(*this, *pinConfig()), std::memory_order_relaxed);
+	unpinConfig();
+	_next = registry.sites;
+	registry.sites = this;
+}
+
+void Logger::updateSites(const Config &config)
+{
+	CallSiteRegistry &registry = CallSiteRegistry::get();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	registry.update(config);
+}
+
+bool Logger::setLevel(const std::string &pattern, const std::string &level)
+{
+	const int severity = CallSiteRegistry::getSeverity(CallSiteRegistry::trim(level));
+	if (severity < 0) return false;
+
+	CallSiteRegistry &registry = CallSiteRegistry::get();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	CallSiteRegistry::Rule rule = { pattern, severity };
+	registry.rules.push_back(rule);
+	registry.update();
+	return true;
+}
+
+void Logger::setLevel(const std::string &pattern, LogLevel level)
+{
+	setLevel(pattern, getLevelDescr(level));
+}
+
+void Logger::clearLevels()
+{
+	CallSiteRegistry &registry = CallSiteRegistry::get();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	registry.rules.clear();
+	registry.update();
+}
+
+bool Logger::loadLevels(const std::string &file_name)
+{
+	std::ifstream file(file_name.c_str());
+	if (!file.is_open()) return false;
+
+	std::stringstream text;
+	text << file.rdbuf();
+
+	CallSiteRegistry &registry = CallSiteRegistry::get();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	const bool valid = registry.parse(text.str(), '\n');
+	registry.update();
+	return valid;
+}
+
+} /* namespace nl_uu_science_gmt */
@@ -0,0 +1,222 @@
+/*
+ * CrashRing.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+#include "CrashRing.h"
+#include "Logger.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <mutex>
+
+namespace nl_uu_science_gmt
+{
+
+std::atomic<bool> CrashRing::_enabled(false);
+
+namespace
+{
+
+struct Ring
+{
+	char* data;
+	std::atomic<size_t> position; // total number of bytes written
+	std::atomic<bool> in_use;
+	long thread_id;
+	Ring* next;
+};
+
+// rings are never freed, a thread that exits hands its ring to the next new thread
+std::atomic<Ring*> rings(NULL);
+size_t ring_capacity = 0;
+char dump_file_name[4096];
+
+const int crash_signals[] = { SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL };
+const int crash_signal_count = sizeof(crash_signals) / sizeof(crash_signals[0]);
+struct sigaction previous_actions[crash_signal_count];
+
+Ring* acquireRing()
+{
+	for (Ring* ring = rings.load(); ring != NULL; ring = ring->next)
+	{
+		bool free = false;
+		if (ring->in_use.compare_exchange_strong(free, true))
+		{
+			ring->thread_id = Logger::getThreadId();
+			ring->position = 0;
+			return ring;
+		}
+	}
+
+	Ring* ring = new Ring;
+	ring->data = new char[ring_capacity];
+	ring->position = 0;
+	ring->in_use = true;
+	ring->thread_id = Logger::getThreadId();
+	ring->next = rings.load();
+	while (!rings.compare_exchange_weak(ring->next, ring))
+		;
+	return ring;
+}
+
+struct ThreadRing
+{
+	Ring* ring;
+
+	ThreadRing() :
+			ring(acquireRing())
+	{
+	}
+
+	~ThreadRing()
+	{
+		ring->in_use = false;
+	}
+};
+
+bool writeAll(int fd, const char* data, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t written = ::write(fd, data, length);
+		if (written <= 0) return false;
+		data += written;
+		length -= written;
+	}
+	return true;
+}
+
+/*
+ * Decimal representation without snprintf, which is not async-signal-safe
+ */
+size_t formatNumber(long value, char* buffer)
+{
+	char digits[24];
+	size_t count = 0;
+	unsigned long magnitude = value < 0 ? -(unsigned long) value : value;
+	do
+	{
+		digits[count++] = '0' + magnitude % 10;
+		magnitude /= 10;
+	}
+	while (magnitude > 0);
+
+	size_t length = 0;
+	if (value < 0) buffer[length++] = '-';
+	while (count > 0)
+		buffer[length++] = digits[--count];
+	return length;
+}
+
+void onCrashSignal(int signal)
+{
+	CrashRing::dump();
+
+	for (int s = 0; s < crash_signal_count; ++s)
+	{
+		if (crash_signals[s] == signal) sigaction(signal, &previous_actions[s], NULL);
+	}
+	raise(signal);
+}
+
+} /* namespace */
+
+void CrashRing::install(const std::string &dump_file, size_t capacity)
+{
+	static std::mutex mutex;
+	std::lock_guard<std::mutex> lock(mutex);
+	if (isEnabled()) return;
+
+	ring_capacity = capacity > 0 ? capacity : 1;
+	strncpy(dump_file_name, dump_file.c_str(), sizeof(dump_file_name) - 1);
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = onCrashSignal;
+	sigemptyset(&action.sa_mask);
+	for (int s = 0; s < crash_signal_count; ++s)
+		sigaction(crash_signals[s], &action, &previous_actions[s]);
+
+	_enabled.store(true);
+
+	// call sites disabled only by the settings are to be recorded again
+	Logger::configure(Logger::copyConfig());
+}
+
+void CrashRing::record(const char* data, size_t length)
+{
+	static thread_local ThreadRing thread_ring;
+	Ring* ring = thread_ring.ring;
+
+	const size_t capacity = ring_capacity;
+	size_t position = ring->position.load(std::memory_order_relaxed);
+
+	// a record longer than the ring only keeps its tail
+	if (length + 1 > capacity)
+	{
+		data += length + 1 - capacity;
+		length = capacity - 1;
+	}
+
+	size_t offset = position % capacity;
+	size_t first = MIN(length, capacity - offset);
+	memcpy(ring->data + offset, data, first);
+	memcpy(ring->data, data + first, length - first);
+	ring->data[(offset + length) % capacity] = '\n';
+
+	ring->position.store(position + length + 1, std::memory_order_release);
+}
+
+bool CrashRing::dump(const char* file_name)
+{
+	if (!isEnabled()) return false;
+
+	int fd = open(file_name != NULL ? file_name : dump_file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return false;
+
+	bool ok = true;
+	for (Ring* ring = rings.load(); ring != NULL; ring = ring->next)
+	{
+		const size_t position = ring->position.load(std::memory_order_acquire);
+		if (position == 0) continue;
+
+		char header[64] = "=== thread ";
+		size_t header_length = strlen(header);
+		header_length += formatNumber(ring->thread_id, header + header_length);
+		memcpy(header + header_length, " ===\n", 5);
+		ok &= writeAll(fd, header, header_length + 5);
+
+		const size_t capacity = ring_capacity;
+		if (position <= capacity)
+		{
+			ok &= writeAll(fd, ring->data, position);
+		}
+		else
+		{
+			// the oldest record has been partly overwritten, start at the next one
+			const size_t offset = position % capacity;
+			const char* start = ring->data + offset;
+			const char* end = ring->data + capacity;
+			const char* newline = static_cast<const char*>(memchr(start, '\n', end - start));
+			if (newline != NULL)
+			{
+				ok &= writeAll(fd, newline + 1, end - newline - 1);
+				ok &= writeAll(fd, ring->data, offset);
+			}
+			else
+			{
+				newline = static_cast<const char*>(memchr(ring->data, '\n', offset));
+				if (newline != NULL) ok &= writeAll(fd, newline + 1, ring->data + offset - newline - 1);
+			}
+		}
+	}
+
+	close(fd);
+	return ok;
+}
+
+} /* namespace nl_uu_science_gmt */
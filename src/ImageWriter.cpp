@@ -0,0 +1,200 @@
+/*
+ * ImageWriter.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+#include "ImageWriter.h"
+#include "Logger.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <boost/filesystem/operations.hpp>
+#include "opencv2/imgcodecs/imgcodecs.hpp"
+
+namespace nl_uu_science_gmt
+{
+
+namespace
+{
+
+struct Queue
+{
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::condition_variable idle;
+	std::deque<std::pair<std::string, cv::Mat> > images;
+	std::thread worker;
+	bool stop;
+	bool busy;
+
+	bool configured;
+	std::string directory;
+	std::string created; // directory the images were last queued for
+	std::string prefix;
+	std::string extension;
+	int max_side;
+	size_t capacity;
+
+	unsigned long sequence;
+	std::atomic<size_t> dropped;
+
+	Queue() :
+			stop(false), busy(false), configured(false), extension(".png"), max_side(320), capacity(16), sequence(
+					0), dropped(0)
+	{
+	}
+
+	// writes what is still queued before the program exits
+	~Queue()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		ready.notify_all();
+		if (worker.joinable()) worker.join();
+	}
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			while (images.empty() && !stop)
+				ready.wait(lock);
+			if (images.empty()) break;
+
+			std::pair<std::string, cv::Mat> image;
+			image.swap(images.front());
+			images.pop_front();
+			busy = true;
+			lock.unlock();
+
+			bool written = false;
+			try
+			{
+				written = cv::imwrite(image.first, image.second);
+			}
+			catch (const cv::Exception &)
+			{
+			}
+			if (!written) std::cerr << "Unable to write image: " << image.first << std::endl;
+
+			lock.lock();
+			busy = false;
+			if (images.empty()) idle.notify_all();
+		}
+	}
+};
+
+Queue& getQueue()
+{
+	static Queue queue;
+	return queue;
+}
+
+/*
+ * Image files are named after the log-file, next to it
+ */
+void useLogFileName(Queue &queue)
+{
+	const std::string log_file = Logger::LogFileName;
+	const size_t slash = log_file.find_last_of("\\/");
+	const std::string file = slash == std::string::npos ? log_file : log_file.substr(slash + 1);
+
+	queue.directory = slash == std::string::npos ? std::string() : log_file.substr(0, slash);
+	queue.prefix = file.substr(0, file.find_last_of('.'));
+	queue.configured = true;
+}
+
+} /* namespace */
+
+void ImageWriter::configure(const std::string &directory, int max_side, size_t capacity, const std::string &extension)
+{
+	Queue &queue = getQueue();
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	useLogFileName(queue);
+	queue.directory = directory;
+	queue.max_side = MAX(max_side, 1);
+	queue.capacity = capacity;
+	queue.extension = extension;
+}
+
+int ImageWriter::getMaxSide()
+{
+	Queue &queue = getQueue();
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	return queue.max_side;
+}
+
+std::string ImageWriter::write(const cv::Mat &image, const char* name)
+{
+	Queue &queue = getQueue();
+	std::unique_lock<std::mutex> lock(queue.mutex);
+
+	if (queue.images.size() >= queue.capacity)
+	{
+		queue.dropped.fetch_add(1, std::memory_order_relaxed);
+		return std::string();
+	}
+
+	if (!queue.configured) useLogFileName(queue);
+	if (queue.directory != queue.created)
+	{
+		try
+		{
+			boost::filesystem::create_directories(queue.directory);
+		}
+		catch (const boost::filesystem::filesystem_error &)
+		{
+			// tried again with the next image
+			std::cerr << "Unable to create image directory: " << queue.directory << std::endl;
+			queue.dropped.fetch_add(1, std::memory_order_relaxed);
+			return std::string();
+		}
+		queue.created = queue.directory;
+	}
+	if (!queue.worker.joinable()) queue.worker = std::thread(&Queue::run, &queue);
+
+	char number[24];
+	snprintf(number, sizeof(number), "%06lu", ++queue.sequence);
+
+	std::string file_name = queue.directory.empty() ? std::string() : queue.directory + "/";
+	file_name += queue.prefix + "_";
+	if (name != NULL)
+	{
+		std::string label = name;
+		for (size_t i = 0; i < label.length(); ++i)
+			if (label[i] == '/' || label[i] == '\\' || label[i] == ' ') label[i] = '_';
+		file_name += label + "_";
+	}
+	file_name += number + queue.extension;
+
+	queue.images.push_back(std::make_pair(file_name, image));
+	lock.unlock();
+	queue.ready.notify_one();
+
+	return file_name;
+}
+
+void ImageWriter::flush()
+{
+	Queue &queue = getQueue();
+	std::unique_lock<std::mutex> lock(queue.mutex);
+	while (!queue.images.empty() || queue.busy)
+		queue.idle.wait(lock);
+}
+
+size_t ImageWriter::getDropped()
+{
+	return getQueue().dropped.load(std::memory_order_relaxed);
+}
+
+} /* namespace nl_uu_science_gmt */
@@ -0,0 +1,152 @@
+/*
+ * JsonWriter.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+#include "JsonWriter.h"
+#include "Logger.h"
+
+namespace nl_uu_science_gmt
+{
+
+JsonWriter& JsonWriter::string(const char* text, size_t length)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	_out.push_back('"');
+
+	// copy runs of characters that need no escaping in one go
+	const char* run = text;
+	const char* end = text + length;
+	for (const char* c = text; c != end; ++c)
+	{
+		const unsigned char u = *c;
+		if (u >= 0x20 && u != '"' && u != '\\') continue;
+
+		_out.append(run, c - run);
+		run = c + 1;
+
+		switch (u)
+		{
+			case '"':
+				_out.append("\\\"", 2);
+				break;
+			case '\\':
+				_out.append("\\\\", 2);
+				break;
+			case '\n':
+				_out.append("\\n", 2);
+				break;
+			case '\r':
+				_out.append("\\r", 2);
+				break;
+			case '\t':
+				_out.append("\\t", 2);
+				break;
+			case '\b':
+				_out.append("\\b", 2);
+				break;
+			case '\f':
+				_out.append("\\f", 2);
+				break;
+			default:
+			{
+				char escaped[6] = { '\\', 'u', '0', '0', hex[u >> 4], hex[u & 0xf] };
+				_out.append(escaped, 6);
+				break;
+			}
+		}
+	}
+	_out.append(run, end - run);
+
+	_out.push_back('"');
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(long input)
+{
+	char buffer[24];
+	int length = snprintf(buffer, sizeof(buffer), "%ld", input);
+	return raw(buffer, length);
+}
+
+JsonWriter& JsonWriter::value(long unsigned int input)
+{
+	char buffer[24];
+	int length = snprintf(buffer, sizeof(buffer), "%lu", input);
+	return raw(buffer, length);
+}
+
+/*
+ * JSON has no representation for NaN and infinity
+ */
+JsonWriter& JsonWriter::value(double input)
+{
+	if (input != input || input == INFINITY || input == -INFINITY) return raw("null", 4);
+
+	char buffer[32];
+	int length = snprintf(buffer, sizeof(buffer), "%.17g", input);
+	return raw(buffer, length);
+}
+
+template<typename T>
+static void writeMatData(JsonWriter &writer, const cv::Mat &mat)
+{
+	const T* data = mat.ptr<T>();
+	const size_t count = mat.total() * mat.channels();
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (i > 0) writer.raw(",", 1);
+		writer.value(data[i]);
+	}
+}
+
+JsonWriter& JsonWriter::value(const cv::Mat &input)
+{
+	raw("{\"type\":").string(Logger::getMatDepthFromCode(input.type()));
+
+	raw(",\"size\":[");
+	for (int d = 0; d < input.dims; ++d)
+	{
+		if (d > 0) _out.push_back(',');
+		value(input.size[d]);
+	}
+
+	raw("],\"data\":[");
+	const cv::Mat mat = input.isContinuous() ? input : input.clone();
+	switch (mat.depth())
+	{
+		case CV_8U:
+			writeMatData<uchar>(*this, mat);
+			break;
+		case CV_8S:
+			writeMatData<schar>(*this, mat);
+			break;
+		case CV_16U:
+			writeMatData<ushort>(*this, mat);
+			break;
+		case CV_16S:
+			writeMatData<short>(*this, mat);
+			break;
+		case CV_32S:
+			writeMatData<int>(*this, mat);
+			break;
+		case CV_32F:
+			writeMatData<float>(*this, mat);
+			break;
+		case CV_64F:
+			writeMatData<double>(*this, mat);
+			break;
+		default:
+		{
+			cv::Mat widened;
+			mat.convertTo(widened, CV_32F);
+			writeMatData<float>(*this, widened);
+			break;
+		}
+	}
+
+	return raw("]}");
+}
+
+} /* namespace nl_uu_science_gmt */
@@ -0,0 +1,101 @@
+/*
+ * LogContext.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+#include "LogContext.h"
+
+#include <pthread.h>
+
+namespace nl_uu_science_gmt
+{
+
+namespace
+{
+
+struct ThreadContext
+{
+	struct Entry
+	{
+		std::string key;
+		std::string text;
+		std::string json;
+	};
+
+	std::string name;
+	std::vector<Entry> entries; // outermost first
+	LogContext::Tags tags;
+
+	bool isHidden(size_t i) const
+	{
+		for (size_t j = i + 1; j < entries.size(); ++j)
+			if (entries[j].key == entries[i].key) return true;
+		return false;
+	}
+
+	void render()
+	{
+		tags.text.clear();
+		tags.json.clear();
+		if (name.empty() && entries.empty()) return;
+
+		JsonWriter json(tags.json);
+		tags.text = " [" + name;
+		if (!name.empty()) json.raw(",", 1).key("thread_name").string(name);
+
+		bool first = true;
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			if (isHidden(i)) continue;
+
+			if (!first || !name.empty()) tags.text += ' ';
+			tags.text += entries[i].key + "=" + entries[i].text;
+
+			json.raw(first ? ",\"ctx\":{" : ",");
+			json.key(entries[i].key.c_str()).raw(entries[i].json.data(), entries[i].json.length());
+			first = false;
+		}
+
+		tags.text += ']';
+		if (!first) json.raw("}", 1);
+	}
+};
+
+thread_local ThreadContext context;
+
+} /* namespace */
+
+void LogContext::push(const char* key, const std::string &text, const std::string &json)
+{
+	ThreadContext::Entry entry = { key, text, json };
+	context.entries.push_back(entry);
+	context.render();
+}
+
+LogContext::~LogContext()
+{
+	context.entries.pop_back();
+	context.render();
+}
+
+void LogContext::setThreadName(const std::string &name)
+{
+	context.name = name;
+	context.render();
+
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#endif
+}
+
+std::string LogContext::getThreadName()
+{
+	return context.name;
+}
+
+const LogContext::Tags& LogContext::getTags()
+{
+	return context.tags;
+}
+
+} /* namespace nl_uu_science_gmt */
@@ -0,0 +1,47 @@
+/*
+ * LogScope.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+#include "LogScope.h"
+
+#include <time.h>
+
+namespace nl_uu_science_gmt
+{
+
+static thread_local int scope_depth = 0;
+
+LogScope::LogScope(const char* name, const char* file, int line) :
+		_name(name), _file(file), _line(line), _start(getMonotonicTime()), _depth(0), _running(
+				Logger::Tracing)
+{
+	if (_running) _depth = scope_depth++;
+}
+
+void LogScope::stop()
+{
+	if (!_running) return;
+
+	const int64_t end = getMonotonicTime();
+	_running = false;
+	--scope_depth;
+
+	Logger logger = Logger::create(Logger::LOG_DEBUG, _file, _line);
+	logger._stream->trace = true;
+	logger._stream->trace_name = _name;
+	logger._stream->trace_start = _start;
+	logger._stream->trace_duration = end - _start;
+	logger._stream->trace_depth = _depth;
+
+	logger << std::string(2 * _depth, ' ') << _name << ": " << (end - _start) / 1000.0 << " ms";
+}
+
+int64_t LogScope::getMonotonicTime()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+} /* namespace nl_uu_science_gmt */
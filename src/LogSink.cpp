@@ -0,0 +1,591 @@
+/*
+ * LogSink.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+#include "LogSink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <boost/filesystem/operations.hpp>
+
+namespace nl_uu_science_gmt
+{
+
+void ConsoleSink::write(Logger::LogLevel level, const std::string &record)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	switch (level)
+	{
+		case Logger::LOG_ERROR:
+			if (_color) std::cerr << Logger::Color_RED;
+			std::cerr << record << std::endl;
+			if (_color) std::cerr << Logger::Color_RESET;
+			break;
+		case Logger::LOG_WARN:
+			if (_color) std::cerr << Logger::Color_YELLOW;
+			std::cerr << record << std::endl;
+			if (_color) std::cerr << Logger::Color_RESET;
+			break;
+		case Logger::LOG_DEBUG:
+			if (_color) std::clog << Logger::Color_CYAN;
+			std::clog << record << std::endl;
+			if (_color) std::clog << Logger::Color_RESET;
+			break;
+		case Logger::LOG_INFO:
+		default:
+			std::cout << record << std::endl;
+			break;
+	}
+}
+
+FileSink::FileSink(const std::string &file_name, Logger::LogLevel level, Logger::LogLayout layout, bool flush) :
+		LogSink(level, layout), _file_name(file_name), _policy(flush ? 1 : 0), _file(NULL), _unflushed(0), _sync(
+				false), _stop(false), _syncs(0), _index(NULL), _bucket(0), _bucket_start(0), _offset(0)
+{
+	open(layout);
+}
+
+FileSink::FileSink(const std::string &file_name, const FlushPolicy &policy, Logger::LogLevel level,
+		Logger::LogLayout layout) :
+		LogSink(level, layout), _file_name(file_name), _policy(policy), _file(NULL), _unflushed(0), _sync(false), _stop(
+				false), _syncs(0), _index(NULL), _bucket(0), _bucket_start(0), _offset(0)
+{
+	open(layout);
+
+	// the interval needs a timer even when no records arrive
+	if (_file != NULL && (_policy.interval > 0 || _policy.sync)) _worker = std::thread(&FileSink::run, this);
+}
+
+FileSink::~FileSink()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_ready.notify_one();
+	if (_worker.joinable()) _worker.join();
+
+	if (_file == NULL) return;
+	fflush(_file);
+	if (_policy.sync) fdatasync(fileno(_file));
+	fclose(_file);
+
+	if (_index == NULL) return;
+	writeIndex();
+	fclose(_index);
+}
+
+void FileSink::open(Logger::LogLayout layout)
+{
+	const bool empty = !boost::filesystem::exists(_file_name) || boost::filesystem::file_size(_file_name) == 0;
+
+	_file = fopen(_file_name.c_str(), "a");
+	if (_file == NULL)
+	{
+		std::string path = _file_name;
+		path = path.substr(0, path.find_last_of("\\/"));
+		boost::filesystem::create_directories(path);
+		_file = fopen(_file_name.c_str(), "a");
+	}
+
+	if (_file == NULL)
+	{
+		std::cerr << "Unable to open logfile: " << _file_name << std::endl;
+		return;
+	}
+
+	// the policy decides when to flush, not the size of the buffer
+	setvbuf(_file, NULL, _IOFBF, 1 << 16);
+	if (empty && layout == Logger::LAYOUT_TRACE)
+		fputs("[\n", _file); // trace events form a JSON array
+}
+
+void FileSink::write(Logger::LogLevel level, const std::string &record)
+{
+	static const std::string unknown;
+	const Origin origin = { timeval(), unknown, 0 };
+	write(level, record, origin);
+}
+
+static void appendVarint(std::string &out, uint64_t value)
+{
+	for (; value >= 0x80; value >>= 7)
+		out.push_back((char) (value | 0x80));
+	out.push_back((char) value);
+}
+
+template<typename T>
+static void writeLittleEndian(T value, FILE* out)
+{
+	for (size_t i = 0; i < sizeof(T); ++i)
+		fputc((int) ((uint64_t) value >> (8 * i)) & 0xff, out);
+}
+
+void FileSink::write(Logger::LogLevel level, const std::string &record, const Origin &origin)
+{
+	if (_file == NULL) return;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	fwrite(record.data(), 1, record.length(), _file);
+	fputc('\n', _file);
+	++_unflushed;
+
+	if (_index != NULL)
+	{
+		// records of a Logger that is not made by create() have no time
+		timeval now = origin.time;
+		if (now.tv_sec == 0) gettimeofday(&now, NULL);
+
+		const int64_t time = (int64_t) now.tv_sec * 1000000 + now.tv_usec;
+		const int64_t bucket = time - time % (_bucket * 1000);
+		if (bucket != _bucket_start)
+		{
+			writeIndex();
+			_bucket_start = bucket;
+		}
+
+		IndexBlock &block = _blocks[std::make_tuple((int) level, origin.file, origin.line)];
+		if (block.count++ == 0) block.first = block.end = _offset;
+		appendVarint(block.records, _offset - block.end);
+		appendVarint(block.records, record.length());
+		block.end = _offset + record.length();
+	}
+	_offset += record.length() + 1;
+
+	if (_policy.records > 0 && _unflushed >= _policy.records)
+	{
+		flushLocked();
+	}
+	else if (_policy.warnings && Logger::getSeverity(level) >= Logger::getSeverity(Logger::LOG_WARN))
+	{
+		flushLocked();
+	}
+	else if (_unflushed == 1 && _policy.interval > 0)
+	{
+		_oldest = std::chrono::steady_clock::now();
+		_ready.notify_one();
+	}
+}
+
+void FileSink::flush()
+{
+	if (_file == NULL) return;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	flushLocked();
+}
+
+bool FileSink::setIndex(int bucket)
+{
+	if (_file == NULL || bucket <= 0) return false;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_index != NULL) return true;
+
+	const std::string name = _file_name + ".idx";
+	const bool empty = !boost::filesystem::exists(name) || boost::filesystem::file_size(name) == 0;
+	_index = fopen(name.c_str(), "a");
+	if (_index == NULL) return false;
+
+	if (empty)
+	{
+		fwrite("CVLOGIDX", 1, 8, _index);
+		writeLittleEndian<uint32_t>(1, _index);
+		writeLittleEndian<uint32_t>(bucket, _index);
+		fflush(_index);
+	}
+
+	fflush(_file);
+	struct stat status;
+	_offset = fstat(fileno(_file), &status) == 0 ? status.st_size : 0;
+	_bucket = bucket;
+	return true;
+}
+
+/*
+ * One block per level and call site of the records since the last time:
+ * bucket start (int64, us), level (uint8), line (uint32), file name length
+ * (uint16) and name, record count (uint32), offset of the first record
+ * (uint64), size (uint32) and data of the varint (gap, length) pairs of the
+ * records, the gap from the end of the record before, all little-endian
+ */
+void FileSink::writeIndex()
+{
+	for (IndexBlocks::const_iterator b = _blocks.begin(); b != _blocks.end(); ++b)
+	{
+		const std::string &file = std::get<1>(b->first);
+		const IndexBlock &block = b->second;
+
+		writeLittleEndian<int64_t>(_bucket_start, _index);
+		writeLittleEndian<uint8_t>(std::get<0>(b->first), _index);
+		writeLittleEndian<uint32_t>(std::get<2>(b->first), _index);
+		writeLittleEndian<uint16_t>(file.length(), _index);
+		fwrite(file.data(), 1, file.length(), _index);
+		writeLittleEndian<uint32_t>(block.count, _index);
+		writeLittleEndian<uint64_t>(block.first, _index);
+		writeLittleEndian<uint32_t>(block.records.length(), _index);
+		fwrite(block.records.data(), 1, block.records.length(), _index);
+	}
+	_blocks.clear();
+}
+
+void FileSink::flushLocked()
+{
+	fflush(_file);
+	_unflushed = 0;
+
+	// the index never refers to records that are not in the file yet
+	if (_index != NULL)
+	{
+		writeIndex();
+		fflush(_index);
+	}
+
+	if (_policy.sync)
+	{
+		_sync = true;
+		_ready.notify_one();
+	}
+}
+
+/*
+ * Flushes records that are older than the interval, and syncs without
+ * holding the lock so that writers are not blocked by the disk
+ */
+void FileSink::run()
+{
+	const std::chrono::milliseconds interval(_policy.interval);
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (!_stop)
+	{
+		if (_unflushed > 0 && _policy.interval > 0)
+		{
+			const std::chrono::steady_clock::time_point deadline = _oldest + interval;
+			if (std::chrono::steady_clock::now() >= deadline)
+				flushLocked();
+			else if (!_sync)
+			{
+				_ready.wait_until(lock, deadline);
+				continue;
+			}
+		}
+
+		if (_sync)
+		{
+			_sync = false;
+			const int fd = fileno(_file);
+			lock.unlock();
+			fdatasync(fd);
+			_syncs.fetch_add(1, std::memory_order_relaxed);
+			lock.lock();
+			continue;
+		}
+
+		_ready.wait(lock);
+	}
+}
+
+void MemorySink::write(Logger::LogLevel, const std::string &record)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_capacity == 0) return;
+	if (_records.size() == _capacity) _records.pop_front();
+	_records.push_back(record);
+}
+
+std::vector<std::string> MemorySink::getRecords() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return std::vector<std::string>(_records.begin(), _records.end());
+}
+
+void MemorySink::clear()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_records.clear();
+}
+
+MmapRingSink::MmapRingSink(const std::string &file_name, size_t capacity, Logger::LogLevel level,
+		Logger::LogLayout layout) :
+		LogSink(level, layout), _header(NULL), _data(NULL), _mapped(sizeof(RingHeader) + capacity)
+{
+	int fd = open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, _mapped) != 0)
+	{
+		if (fd >= 0) close(fd);
+		std::cerr << "Unable to create log ring: " << file_name << std::endl;
+		return;
+	}
+
+	void* mapped = mmap(NULL, _mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+	{
+		std::cerr << "Unable to map log ring: " << file_name << std::endl;
+		return;
+	}
+
+	_header = static_cast<RingHeader*>(mapped);
+	memcpy(_header->magic, "CVLOGRNG", sizeof(_header->magic));
+	_header->capacity = capacity;
+	_header->position = 0;
+	_data = static_cast<char*>(mapped) + sizeof(RingHeader);
+}
+
+MmapRingSink::~MmapRingSink()
+{
+	if (_header != NULL) munmap(_header, _mapped);
+}
+
+void MmapRingSink::write(Logger::LogLevel, const std::string &record)
+{
+	if (_header == NULL || _header->capacity == 0) return;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	const uint64_t capacity = _header->capacity;
+	uint64_t position = _header->position;
+
+	// a record longer than the ring only keeps its tail
+	const char* data = record.data();
+	size_t length = record.length();
+	if (length + 1 > capacity)
+	{
+		data += length + 1 - capacity;
+		length = capacity - 1;
+	}
+
+	size_t offset = position % capacity;
+	size_t first = MIN(length, capacity - offset);
+	memcpy(_data + offset, data, first);
+	memcpy(_data, data + first, length - first);
+	_data[(offset + length) % capacity] = '\n';
+
+	_header->position = position + length + 1;
+}
+
+SyslogSink::SyslogSink(const std::string &path, const std::string &ident, Logger::LogLevel level,
+		Logger::LogLayout layout) :
+		LogSink(level, layout), _path(path), _ident(ident), _socket(socket(AF_UNIX, SOCK_DGRAM, 0))
+{
+	if (_socket >= 0) fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL) | O_NONBLOCK);
+}
+
+SyslogSink::~SyslogSink()
+{
+	if (_socket >= 0) close(_socket);
+}
+
+void SyslogSink::write(Logger::LogLevel level, const std::string &record)
+{
+	if (_socket < 0) return;
+
+	// facility user (1), severity as defined by RFC 5424
+	int severity;
+	switch (level)
+	{
+		case Logger::LOG_ERROR:
+			severity = 3;
+			break;
+		case Logger::LOG_WARN:
+			severity = 4;
+			break;
+		case Logger::LOG_DEBUG:
+			severity = 7;
+			break;
+		case Logger::LOG_INFO:
+		default:
+			severity = 6;
+			break;
+	}
+
+	char prefix[16];
+	int prefix_length = snprintf(prefix, sizeof(prefix), "<%d>", 8 + severity);
+
+	static thread_local std::string datagram;
+	datagram.assign(prefix, prefix_length);
+	datagram += _ident;
+	datagram += ": ";
+	datagram += record;
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, _path.c_str(), sizeof(address.sun_path) - 1);
+
+	sendto(_socket, datagram.data(), datagram.length(), MSG_DONTWAIT, (const sockaddr*) &address, sizeof(address));
+}
+
+/*
+ * Least time between attempts to reach the collector, and how long the
+ * backlog may take to drain when the sink is destroyed
+ */
+static const int ReconnectInterval = 250; // ms
+static const int DrainTimeout = 1000; // ms
+
+static int connectSocket(const std::string &path, int type)
+{
+	int fd = socket(AF_UNIX, type, 0);
+	if (fd < 0) return -1;
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+	if (connect(fd, (const sockaddr*) &address, sizeof(address)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+static inline size_t getFrameLength(const std::string &frames, size_t start)
+{
+	const unsigned char* length = (const unsigned char*) frames.data() + start;
+	return 4 + (((size_t) length[0] << 24) | ((size_t) length[1] << 16) | ((size_t) length[2] << 8) | length[3]);
+}
+
+SocketSink::SocketSink(const std::string &path, int type, size_t capacity, Logger::LogLevel level,
+		Logger::LogLayout layout) :
+		LogSink(level, layout), _path(path), _type(type), _capacity(capacity), _sent(0), _stop(false), _dropped(0), _connected(
+				false)
+{
+	_worker = std::thread(&SocketSink::run, this);
+}
+
+SocketSink::~SocketSink()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_ready.notify_all();
+	_worker.join();
+}
+
+void SocketSink::write(Logger::LogLevel level, const std::string &record)
+{
+	const size_t length = 1 + record.length();
+	const char header[5] = { (char) (length >> 24), (char) (length >> 16), (char) (length >> 8), (char) length,
+			(char) level };
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_backlog.length() + 4 + length > _capacity)
+		{
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		_backlog.append(header, sizeof(header));
+		_backlog.append(record);
+	}
+	_ready.notify_one();
+}
+
+/*
+ * Takes the backlog as a whole and sends it frame aligned, so writers only
+ * wait for the swap, never for the socket
+ */
+void SocketSink::run()
+{
+	int fd = -1;
+	std::string frames;
+	size_t frame = 0; // start of the frame being sent
+	int waited = 0;
+	std::chrono::steady_clock::time_point retry; // of the next connect
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	for (;;)
+	{
+		if (_sent == frames.length())
+		{
+			while (_backlog.empty() && !_stop)
+				_ready.wait(lock);
+
+			frames.clear();
+			frames.swap(_backlog);
+			_sent = frame = 0;
+		}
+
+		const bool stop = _stop;
+		if (frames.empty() && stop) break;
+		lock.unlock();
+
+		// a last attempt when stopped, otherwise once per interval however many records arrive
+		if (fd < 0 && (stop || std::chrono::steady_clock::now() >= retry))
+		{
+			fd = connectSocket(_path, _type);
+			_connected.store(fd >= 0, std::memory_order_relaxed);
+			retry = std::chrono::steady_clock::now() + std::chrono::milliseconds(ReconnectInterval);
+		}
+
+		if (fd < 0)
+		{
+			lock.lock();
+			if (stop) break;
+			while (!_stop && std::chrono::steady_clock::now() < retry)
+				_ready.wait_until(lock, retry);
+			continue;
+		}
+
+		// stream sockets take any part of the frames, others one frame per send
+		const size_t length = _type == SOCK_STREAM ? frames.length() - _sent : getFrameLength(frames, _sent);
+		const ssize_t sent = send(fd, frames.data() + _sent, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+		if (sent > 0)
+		{
+			_sent += sent;
+			while (frame < _sent && frame + getFrameLength(frames, frame) <= _sent)
+				frame += getFrameLength(frames, frame);
+			waited = 0;
+		}
+		else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ENOBUFS))
+		{
+			pollfd writable = { fd, POLLOUT, 0 };
+			if (poll(&writable, 1, ReconnectInterval) == 0 && stop && (waited += ReconnectInterval) >= DrainTimeout)
+			{
+				lock.lock();
+				break;
+			}
+		}
+		else if (sent < 0 && errno == EMSGSIZE)
+		{
+			// a record too long for a datagram
+			_sent += length;
+			frame = _sent;
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+		else
+		{
+			// the collector went away, the frame that was cut off is sent again in full
+			close(fd);
+			fd = -1;
+			_connected.store(false, std::memory_order_relaxed);
+			_sent = frame;
+		}
+
+		lock.lock();
+	}
+	lock.unlock();
+
+	if (fd >= 0) close(fd);
+	_connected.store(false, std::memory_order_relaxed);
+}
+
+} /* namespace nl_uu_science_gmt */
@@ -4,43 +4,90 @@
  *  Created on: Mar 28, 2011
  *      Author: Coert van Gemeren (c.j.vangemeren@uu.nl)
  */
+// the scalar and string fast paths are compiled here with CVLOG_OUT_OF_LINE
+#define CVLOG_FAST_PATH_DEFINITIONS
 #include "Logger.h"
+#include "LogSink.h"
+#include "ImageWriter.h"
+#include "LogContext.h"
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <boost/filesystem/operations.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "opencv2/imgproc/imgproc.hpp"
 
 namespace nl_uu_science_gmt
 {
-bool Logger::Quiet = false;
-bool Logger::Debug = false;
-bool Logger::LogToFile = false;
-bool Logger::Fixed = true;
-bool Logger::Flush = false;
-bool Logger::Color = false;
+Logger::Setting<bool> Logger::Quiet(&Logger::Config::quiet);
+Logger::Setting<bool> Logger::Debug(&Logger::Config::debug);
+Logger::Setting<bool> Logger::LogToFile(&Logger::Config::log_to_file);
+Logger::Setting<bool> Logger::Fixed(&Logger::Config::fixed);
+Logger::Setting<bool> Logger::Flush(&Logger::Config::flush);
+Logger::Setting<bool> Logger::Color(&Logger::Config::color);
+Logger::Setting<bool> Logger::Tracing(&Logger::Config::tracing);
+
+Logger::Setting<size_t> Logger::Precision(&Logger::Config::precision);
+Logger::Setting<size_t> Logger::ReferenceWidth(&Logger::Config::reference_width);
+Logger::Setting<size_t> Logger::Size(&Logger::Config::size);
+Logger::Setting<Logger::LogFormat> Logger::OutputFormat(&Logger::Config::output_format);
+Logger::Setting<Logger::LogLayout> Logger::OutputLayout(&Logger::Config::output_layout);
+Logger::Setting<Logger::LogLevel> Logger::Level(&Logger::Config::level);
+Logger::Setting<size_t> Logger::CoalesceWindow(&Logger::Config::coalesce_window);
+Logger::Setting<bool> Logger::StableLayout(&Logger::Config::stable_layout);
+Logger::Setting<size_t> Logger::AsyncQueue(&Logger::Config::async_queue);
+Logger::Setting<std::string> Logger::LogFileName(&Logger::Config::log_file_name);
+
+const char* const Logger::Color_RED = "\033[1m\033[31m";
+const char* const Logger::Color_GREEN = "\033[1m\033[32m";
+const char* const Logger::Color_BLUE = "\033[1m\033[33m";
+const char* const Logger::Color_YELLOW = "\033[1m\033[33m";
+const char* const Logger::Color_CYAN = "\033[1m\033[36m";
+const char* const Logger::Color_RESET = "\033[0m";
+
+Logger Logger::create(const Logger::LogLevel level, const std::string file, const int line, int site_state)
+{
+	if (site_state == SITE_DISABLED) return disabled();
 
-size_t Logger::Precision = 5;
-size_t Logger::ReferenceWidth = 32;
-size_t Logger::Size = 8;
-Logger::LogFormat Logger::OutputFormat = Logger::FORMAT_DEFAULT;
-std::string Logger::LogFileName = "log.txt";
+	Logger logger(level);
+	logger._stream->site_state = site_state;
 
-const Logger::ImageTSMap Logger::ImageTypeStringMapping = Logger::initTypeStringMapping();
-const Logger::ImageTSMap Logger::ImagePrimitiveStringMapping = Logger::initPrimitiveStringMapping();
+	// rendered when the context of the thread changed, see LogContext
+	const LogContext::Tags &context = LogContext::getTags();
+	logger.begin(file, line, context.text, context.json);
 
-const std::string Logger::Color_RED = "\033[1m\033[31m";
-const std::string Logger::Color_GREEN = "\033[1m\033[32m";
-const std::string Logger::Color_BLUE = "\033[1m\033[33m";
-const std::string Logger::Color_YELLOW = "\033[1m\033[33m";
-const std::string Logger::Color_CYAN = "\033[1m\033[36m";
-const std::string Logger::Color_RESET = "\033[0m";
+	return logger;
+}
 
-Logger Logger::create(const Logger::LogLevel level, const std::string file, const int line)
+void Logger::begin(const std::string &file, int line, const std::string &context_text, const std::string &context_json)
 {
-	Logger logger(level);
+	_stream->file = file;
+	_stream->line = line;
+	gettimeofday(&_stream->time, NULL);
+
+	if (_config->layouts & (1 << LAYOUT_JSON)) _stream->fields_json = context_json;
+
+	// JSON records carry the meta data as typed fields instead
+	if (!(_config->layouts & (1 << LAYOUT_TEXT))) return;
 
 	std::stringstream __log_meta;
 	__log_meta << getMicrotime();
 
 	if (line > 0)
 	{
-		size_t __log_maxwidth = logger.getReferenceWidth();
+		size_t __log_maxwidth = getReferenceWidth();
 		std::stringstream __log_msg_line;
 		__log_msg_line << getStrippedFilename(file) << ":" << line;
 		std::string __log_msg = __log_msg_line.str();
@@ -52,83 +99,337 @@ Logger Logger::create(const Logger::LogLevel level, const std::string file, cons
 		__log_meta << " " << __log_pad << __trimmed;
 	}
 
-	logger << __log_meta.str() << " " << getLevelDescr(level) << "\t";
+	*this << __log_meta.str() << " " << getLevelDescr(_stream->log_level) << context_text << "\t";
+	_stream->message_offset = _stream->buffer.size();
+}
+
+Logger::Config::Config() :
+		quiet(false), debug(false), log_to_file(false), fixed(true), flush(false), color(false), tracing(false), precision(
+				5), reference_width(32), size(8), output_format(FORMAT_DEFAULT), output_layout(LAYOUT_TEXT), level(LOG_DEBUG), log_file_name(
+				"log.txt"), coalesce_window(0), stable_layout(false), async_queue(0), sinks(new SinkList()), layouts(
+				1 << LAYOUT_TEXT), version(0)
+{
+}
 
-	return logger;
+static std::atomic<const Logger::Config*> current_config(NULL);
+
+std::mutex& Logger::getConfigMutex()
+{
+	static std::mutex mutex;
+	return mutex;
 }
 
-const std::vector<std::pair<int, char*> > Logger::initTypeStringMapping()
-{
-	std::vector<std::pair<int, char*> > imageTypeStringMapping;
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_8U, (char*) "CV_8U"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_8UC2, (char*) "CV_8UC2"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_8UC3, (char*) "CV_8UC3"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_8UC4, (char*) "CV_8UC4"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_8S, (char*) "CV_8S"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_16U, (char*) "CV_16U"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_16S, (char*) "CV_16S"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_32S, (char*) "CV_32S"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_32F, (char*) "CV_32F"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_32FC2, (char*) "CV_32FC2"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_32FC3, (char*) "CV_32FC3"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_32FC4, (char*) "CV_32FC4"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_32FC(5), (char*) "CV_32FC5"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_64F, (char*) "CV_64F"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_64FC2, (char*) "CV_64FC2"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_64FC3, (char*) "CV_64FC3"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_64FC4, (char*) "CV_64FC4"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_64FC(5), (char*) "CV_64FC5"));
-
-	return imageTypeStringMapping;
-}
-
-const std::vector<std::pair<int, char*> > Logger::initPrimitiveStringMapping()
-{
-	std::vector<std::pair<int, char*> > imageTypeStringMapping;
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_8U, (char*) "uchar"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_8UC2, (char*) "cv::Vec2b"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_8UC3, (char*) "cv::Vec3b"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_8UC4, (char*) "cv::Vec4b"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_8S, (char*) "char"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_16U, (char*) "ushort"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_16S, (char*) "short"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_32S, (char*) "int"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_32F, (char*) "float"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_32FC2, (char*) "cv::Vec2f"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_32FC3, (char*) "cv::Vec3f"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_32FC4, (char*) "cv::Vec4f"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_32FC(5), (char*) "cv::Vec<float, 5>"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_64F, (char*) "double"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_64FC2, (char*) "cv::Vec2d"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_64FC3, (char*) "cv::Vec3d"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_64FC4, (char*) "cv::Vec4d"));
-	imageTypeStringMapping.push_back(std::pair<int, char*>(CV_64FC(5), (char*) "cv::Vec<double, 5>"));
-
-	return imageTypeStringMapping;
-}
-
-const char* Logger::getMatDepthFromCode(int depth)
-{
-	for (size_t i = 0; i < ImageTypeStringMapping.size(); ++i)
-	{
-		if (ImageTypeStringMapping[i].first == depth)
-		{
-			return ImageTypeStringMapping[i].second;
-		}
+const Logger::Config* Logger::getConfig()
+{
+	// sequentially consistent, for the check in pin()
+	const Config* config = current_config.load();
+	if (config != NULL) return config;
+
+	return getDefaultConfig();
+}
+
+/*
+ * Never freed, it is not pinned by the loggers of disabled call sites
+ */
+const Logger::Config* Logger::getDefaultConfig()
+{
+	static const Config defaults;
+	return &defaults;
+}
+
+Logger::Config Logger::copyConfig()
+{
+	const Config config(*pinConfig());
+	unpinConfig();
+	return config;
+}
+
+/*
+ * Snapshots a thread reads, a hazard pointer for loggers and one for single
+ * reads, and the nesting depth of its loggers
+ */
+struct ConfigPin
+{
+	std::atomic<const Logger::Config*> logger;
+	std::atomic<const Logger::Config*> read;
+	int depth;
+
+	ConfigPin();
+	~ConfigPin();
+};
+
+/*
+ * Pins of all threads, and the snapshots that are no longer current but may
+ * still be read. Never destroyed, threads may exit after main.
+ */
+struct ConfigPins
+{
+	std::mutex mutex;
+	std::vector<ConfigPin*> pins;
+	std::vector<const Logger::Config*> retired;
+
+	static ConfigPins& get()
+	{
+		static ConfigPins* pins = new ConfigPins();
+		return *pins;
 	}
-	return "CV_???";
+};
+
+ConfigPin::ConfigPin() :
+		logger(NULL), read(NULL), depth(0)
+{
+	ConfigPins &pins = ConfigPins::get();
+	std::lock_guard<std::mutex> lock(pins.mutex);
+	pins.pins.push_back(this);
 }
 
-const char* Logger::getMatPrimitiveFromCode(int depth)
+ConfigPin::~ConfigPin()
 {
-	for (size_t i = 0; i < ImagePrimitiveStringMapping.size(); ++i)
+	ConfigPins &pins = ConfigPins::get();
+	std::lock_guard<std::mutex> lock(pins.mutex);
+	pins.pins.erase(std::find(pins.pins.begin(), pins.pins.end(), this));
+}
+
+static thread_local ConfigPin config_pin;
+
+/*
+ * Announces the snapshot before it is used and checks that it was still
+ * current afterwards, so the reclaimer either sees the pin or the thread
+ * sees the newer snapshot
+ */
+static const Logger::Config* pin(std::atomic<const Logger::Config*> &slot)
+{
+	for (;;)
 	{
-		if (ImagePrimitiveStringMapping[i].first == depth)
-		{
-			return ImagePrimitiveStringMapping[i].second;
-		}
+		const Logger::Config* config = Logger::getConfig();
+		slot.store(config);
+		if (config == Logger::getConfig()) return config;
+	}
+}
+
+const Logger::Config* Logger::enterConfig()
+{
+	ConfigPin &pinned = config_pin;
+	if (pinned.depth++ > 0) return pinned.logger.load(std::memory_order_relaxed);
+	return pin(pinned.logger);
+}
+
+void Logger::leaveConfig()
+{
+	ConfigPin &pinned = config_pin;
+	if (--pinned.depth > 0) return;
+
+	const Config* config = pinned.logger.load(std::memory_order_relaxed);
+	pinned.logger.store(NULL, std::memory_order_release);
+
+	// the last reader of a retired snapshot frees it
+	if (config != getConfig()) reclaimConfigs();
+}
+
+const Logger::Config* Logger::pinConfig()
+{
+	return pin(config_pin.read);
+}
+
+void Logger::unpinConfig()
+{
+	ConfigPin &pinned = config_pin;
+	const Config* config = pinned.read.load(std::memory_order_relaxed);
+	pinned.read.store(NULL, std::memory_order_release);
+
+	if (config != getConfig()) reclaimConfigs();
+}
+
+void Logger::configure(const Config &config)
+{
+	{
+		std::lock_guard<std::mutex> lock(getConfigMutex());
+		publish(config);
+	}
+	reclaimConfigs();
+}
+
+std::shared_ptr<const Logger::SinkList> Logger::getSinks()
+{
+	const std::shared_ptr<const SinkList> sinks = pinConfig()->sinks;
+	unpinConfig();
+	return sinks;
+}
+
+void Logger::addSink(const cv::Ptr<LogSink> &sink)
+{
+	std::unique_lock<std::mutex> lock(getConfigMutex());
+	Config config(*getConfig());
+	std::shared_ptr<SinkList> sinks(new SinkList(*config.sinks));
+	sinks->push_back(sink);
+	config.sinks = sinks;
+	publish(config);
+	lock.unlock();
+
+	reclaimConfigs();
+}
+
+void Logger::removeSink(const cv::Ptr<LogSink> &sink)
+{
+	std::unique_lock<std::mutex> lock(getConfigMutex());
+	Config config(*getConfig());
+	std::shared_ptr<SinkList> sinks(new SinkList(*config.sinks));
+	for (SinkList::iterator s = sinks->begin(); s != sinks->end();)
+	{
+		if (s->get() == sink.get())
+			s = sinks->erase(s);
+		else
+			++s;
+	}
+	config.sinks = sinks;
+	publish(config);
+	lock.unlock();
+
+	// the sink is destroyed here unless someone else holds it
+	reclaimConfigs();
+}
+
+void Logger::flushSinks()
+{
+	std::shared_ptr<const SinkList> sinks;
+	{
+		std::lock_guard<std::mutex> lock(getConfigMutex());
+		sinks = getConfig()->sinks;
+	}
+
+	for (SinkList::const_iterator sink = sinks->begin(); sink != sinks->end(); ++sink)
+		(*sink)->flush();
+}
+
+void Logger::clearSinks()
+{
+	std::unique_lock<std::mutex> lock(getConfigMutex());
+	Config config(*getConfig());
+	config.sinks.reset(new SinkList());
+	publish(config);
+	lock.unlock();
+
+	reclaimConfigs();
+}
+
+int Logger::getLayouts(const Config &config)
+{
+	if (config.sinks->empty()) return 1 << config.output_layout;
+
+	int layouts = 0;
+	for (SinkList::const_iterator sink = config.sinks->begin(); sink != config.sinks->end(); ++sink)
+		layouts |= 1 << (*sink)->getLayout();
+	return layouts;
+}
+
+template<> struct Logger::MatPrimitive<CV_8U> { typedef uchar type; };
+template<> struct Logger::MatPrimitive<CV_8S> { typedef schar type; };
+template<> struct Logger::MatPrimitive<CV_16U> { typedef ushort type; };
+template<> struct Logger::MatPrimitive<CV_16S> { typedef short type; };
+template<> struct Logger::MatPrimitive<CV_32S> { typedef int type; };
+template<> struct Logger::MatPrimitive<CV_32F> { typedef float type; };
+template<> struct Logger::MatPrimitive<CV_64F> { typedef double type; };
+
+#define LOGGER_MAT_PRINTERS(depth) \
+	{ \
+		&Logger::printMatrix<Logger::MatElementType<depth, 0>::type>, \
+		&Logger::printMatrix<Logger::MatElementType<depth, 1>::type>, \
+		&Logger::printMatrix<Logger::MatElementType<depth, 2>::type>, \
+		&Logger::printMatrix<Logger::MatElementType<depth, 3>::type>, \
+		&Logger::printMatrix<Logger::MatElementType<depth, 4>::type> \
 	}
-	return "???";
+
+/*
+ * Indexed by [depth][channels], where column 0 prints matrices wider than MatVecChannels
+ */
+const Logger::MatPrinter Logger::MatPrinters[MatDepths][MatVecChannels + 1] =
+{
+	LOGGER_MAT_PRINTERS(CV_8U),
+	LOGGER_MAT_PRINTERS(CV_8S),
+	LOGGER_MAT_PRINTERS(CV_16U),
+	LOGGER_MAT_PRINTERS(CV_16S),
+	LOGGER_MAT_PRINTERS(CV_32S),
+	LOGGER_MAT_PRINTERS(CV_32F),
+	LOGGER_MAT_PRINTERS(CV_64F)
+};
+
+#undef LOGGER_MAT_PRINTERS
+
+const char* const Logger::MatTypeNames[CV_DEPTH_MAX][MatVecChannels] =
+{
+	{ "CV_8U", "CV_8UC2", "CV_8UC3", "CV_8UC4" },
+	{ "CV_8S", "CV_8SC2", "CV_8SC3", "CV_8SC4" },
+	{ "CV_16U", "CV_16UC2", "CV_16UC3", "CV_16UC4" },
+	{ "CV_16S", "CV_16SC2", "CV_16SC3", "CV_16SC4" },
+	{ "CV_32S", "CV_32SC2", "CV_32SC3", "CV_32SC4" },
+	{ "CV_32F", "CV_32FC2", "CV_32FC3", "CV_32FC4" },
+	{ "CV_64F", "CV_64FC2", "CV_64FC3", "CV_64FC4" },
+	{ "CV_16F", "CV_16FC2", "CV_16FC3", "CV_16FC4" },
+#ifdef CV_16BF
+	// OpenCV 5
+	{ "CV_16BF", "CV_16BFC2", "CV_16BFC3", "CV_16BFC4" },
+	{ "CV_Bool", "CV_BoolC2", "CV_BoolC3", "CV_BoolC4" },
+	{ "CV_64U", "CV_64UC2", "CV_64UC3", "CV_64UC4" },
+	{ "CV_64S", "CV_64SC2", "CV_64SC3", "CV_64SC4" },
+	{ "CV_32U", "CV_32UC2", "CV_32UC3", "CV_32UC4" }
+#endif
+};
+
+const char* const Logger::MatPrimitiveNames[CV_DEPTH_MAX][MatVecChannels] =
+{
+	{ "uchar", "cv::Vec2b", "cv::Vec3b", "cv::Vec4b" },
+	{ "char", "cv::Vec<char, 2>", "cv::Vec<char, 3>", "cv::Vec<char, 4>" },
+	{ "ushort", "cv::Vec2w", "cv::Vec3w", "cv::Vec4w" },
+	{ "short", "cv::Vec2s", "cv::Vec3s", "cv::Vec4s" },
+	{ "int", "cv::Vec2i", "cv::Vec3i", "cv::Vec4i" },
+	{ "float", "cv::Vec2f", "cv::Vec3f", "cv::Vec4f" },
+	{ "double", "cv::Vec2d", "cv::Vec3d", "cv::Vec4d" },
+	{ "cv::float16_t", "cv::Vec<cv::float16_t, 2>", "cv::Vec<cv::float16_t, 3>", "cv::Vec<cv::float16_t, 4>" },
+#ifdef CV_16BF
+	{ "cv::bfloat", "cv::Vec<cv::bfloat, 2>", "cv::Vec<cv::bfloat, 3>", "cv::Vec<cv::bfloat, 4>" },
+	{ "bool", "cv::Vec<bool, 2>", "cv::Vec<bool, 3>", "cv::Vec<bool, 4>" },
+	{ "uint64_t", "cv::Vec<uint64_t, 2>", "cv::Vec<uint64_t, 3>", "cv::Vec<uint64_t, 4>" },
+	{ "int64_t", "cv::Vec<int64_t, 2>", "cv::Vec<int64_t, 3>", "cv::Vec<int64_t, 4>" },
+	{ "unsigned", "cv::Vec<unsigned, 2>", "cv::Vec<unsigned, 3>", "cv::Vec<unsigned, 4>" }
+#endif
+};
+
+/*
+ * Name of a depth the tables above do not know, as OpenCV gives it
+ */
+static const char* getUnknownTypeName(int type)
+{
+	static thread_local std::string name;
+	name = cv::typeToString(type);
+	return name.c_str();
+}
+
+/*
+ * Names of types with more than MatVecChannels channels are composed into a
+ * per-thread buffer, which stays valid until the next call on the same thread
+ */
+const char* Logger::getMatDepthFromCode(int type)
+{
+	const int depth = CV_MAT_DEPTH(type);
+	const int channels = CV_MAT_CN(type);
+	if (MatTypeNames[depth][0] == NULL) return getUnknownTypeName(type);
+	if (channels <= MatVecChannels) return MatTypeNames[depth][channels - 1];
+
+	static thread_local char name[32];
+	snprintf(name, sizeof(name), "%sC%d", MatTypeNames[depth][0], channels);
+	return name;
+}
+
+const char* Logger::getMatPrimitiveFromCode(int type)
+{
+	const int depth = CV_MAT_DEPTH(type);
+	const int channels = CV_MAT_CN(type);
+	if (MatPrimitiveNames[depth][0] == NULL) return getUnknownTypeName(type);
+	if (channels <= MatVecChannels) return MatPrimitiveNames[depth][channels - 1];
+
+	static thread_local char name[48];
+	snprintf(name, sizeof(name), "cv::Vec<%s, %d>", MatPrimitiveNames[depth][0], channels);
+	return name;
 }
 
 std::string Logger::getDatestamp(time_t unix_t)
@@ -256,6 +557,25 @@ std::string Logger::getStrippedFilename(const std::string &filename)
 	return output;
 }
 
+/*
+ * Order of the levels by importance, DEBUG being the least important
+ */
+int Logger::getSeverity(LogLevel level)
+{
+	switch (level)
+	{
+		case LOG_DEBUG:
+			return 0;
+		case LOG_INFO:
+			return 1;
+		case LOG_WARN:
+			return 2;
+		case LOG_ERROR:
+		default:
+			return 3;
+	}
+}
+
 std::string Logger::getLevelDescr(LogLevel level)
 {
 	switch (level)
@@ -273,6 +593,23 @@ std::string Logger::getLevelDescr(LogLevel level)
 	}
 }
 
+/*
+ * Kernel thread id on Linux, which matches what top and gdb show
+ */
+long Logger::getThreadId()
+{
+	static thread_local long thread_id = 0;
+	if (thread_id == 0)
+	{
+#ifdef SYS_gettid
+		thread_id = syscall(SYS_gettid);
+#else
+		thread_id = (long) std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+	}
+	return thread_id;
+}
+
 void Logger::replaceAll(std::string &source, const std::string &find, const std::string &replace)
 {
 	size_t start_pos = 0;
@@ -311,280 +648,1191 @@ void Logger::replaceAll(std::string &source, const std::string &find, const std:
 //	return _stream->file_buffer.is_open();
 //}
 
-void Logger::output()
+/*
+ * One JSON object per record, without a trailing newline:
+ * {"ts":1760000000.123456,"level":"INFO","file":"main.cpp","line":12,"thread":4242,"msg":"...",<fields>}
+ */
+void Logger::toJson(std::string &out) const
 {
-	const std::string input = _stream->buffer.str();
+	JsonWriter json(out);
 
-	if (_stream->log_level > LOG_WARN)
-	{
-		if (_color) std::cerr << Color_RED;
-		std::cerr << input << std::endl;
-		if (_color) std::cerr << Color_RESET;
-	}
-	else if (_stream->log_level == LOG_WARN)
-	{
-		if (_color) std::cerr << Color_YELLOW;
-		std::cerr << input << std::endl;
-		if (_color) std::cerr << Color_RESET;
-	}
-	else if (_stream->log_level == LOG_DEBUG && (_debug || !_quiet))
-	{
-		if (_color) std::clog << Color_CYAN;
-		std::clog << input << std::endl;
-		if (_color) std::clog << Color_RESET;
-	}
-	else if (_stream->log_level == LOG_INFO && !_quiet)
-	{
-		std::cout << input << std::endl;
-		if (_color) std::cout << Color_RESET;
-	}
-}
+	char ts[32];
+	int ts_length = snprintf(ts, sizeof(ts), "%ld.%06ld", (long) _stream->time.tv_sec, (long) _stream->time.tv_usec);
+	json.raw("{\"ts\":", 6).raw(ts, ts_length);
 
-void Logger::write()
-{
-	const std::string input = _stream->buffer.str();
+	const std::string level = getLevelDescr(_stream->log_level);
+	json.raw(",\"level\":", 9).string(level.data(), level.find_last_not_of(' ') + 1);
 
-	if (_stream->file_buffer.is_open())
-	{
-		_stream->file_buffer << input << std::endl;
-	}
-//		else if (openLogfile(_log_file_name))
-//		{
-//			_stream->file_buffer << input;
-//		}
-	else
+	if (_stream->line > 0)
 	{
-		if (_color) std::cerr << Color_RED;
-		std::cerr << "Unable to open logfile: " << _log_file_name << std::endl;
-		if (_color) std::cerr << Color_RESET;
+		json.raw(",\"file\":", 8).string(_stream->file);
+		json.raw(",\"line\":", 8).value(_stream->line);
 	}
-//	else if (_stream->file_buffer.is_open())
-//	{
-//		closeLogfile();
-//	}
 
-	if (_flush) _stream->file_buffer.flush();
+	json.raw(",\"thread\":", 10).value(_stream->thread != 0 ? _stream->thread : getThreadId());
+	const MessageBuffer &message = _stream->buffer;
+	json.raw(",\"msg\":", 7).string(message.data() + _stream->message_offset, message.size() - _stream->message_offset);
+	json.raw(_stream->fields_json.data(), _stream->fields_json.length());
+	json.raw("}", 1);
 }
 
-Logger& Logger::operator<<(const char* input)
+void Logger::toText(std::string &out) const
 {
-	_stream->buffer << input;
-	return *this;
+	out.assign(_stream->buffer.data(), _stream->buffer.size());
+	out += _stream->fields_text;
 }
 
 /*
- * Cast unsigned char to int to show it as a number
+ * Chrome trace-event "complete" event, followed by a comma as elements of the
+ * JSON array format are (the closing bracket of that format is optional):
+ * {"name":"stage","cat":"cvlog","ph":"X","ts":12,"dur":34,"pid":1,"tid":2,"args":{...}},
  */
-Logger& Logger::operator<<(uchar input)
+void Logger::toTrace(std::string &out) const
 {
-	*this << (int) input;
-	return *this;
+	JsonWriter json(out);
+
+	json.raw("{\"name\":", 8).string(_stream->trace_name);
+	json.raw(",\"cat\":\"cvlog\",\"ph\":\"X\",\"ts\":", 29).value((long) _stream->trace_start);
+	json.raw(",\"dur\":", 7).value((long) _stream->trace_duration);
+	json.raw(",\"pid\":", 7).value((long) getpid());
+	json.raw(",\"tid\":", 7).value(_stream->thread != 0 ? _stream->thread : getThreadId());
+	json.raw(",\"args\":{\"depth\":", 17).value(_stream->trace_depth);
+	json.raw(",\"file\":", 8).string(_stream->file);
+	json.raw(",\"line\":", 8).value(_stream->line);
+	json.raw("}},", 3);
 }
 
-Logger& Logger::operator<<(short input)
+/*
+ * Returns false if the record has no representation in the layout, which is
+ * the case for anything but scope timings in LAYOUT_TRACE
+ */
+bool Logger::render(LogLayout layout, std::string &out) const
 {
-	doIntegerInputMarkup(input, "%d");
-	return *this;
+	switch (layout)
+	{
+		case LAYOUT_TRACE:
+			if (!_stream->trace) return false;
+			toTrace(out);
+			return true;
+		case LAYOUT_JSON:
+			toJson(out);
+			return true;
+		case LAYOUT_TEXT:
+		default:
+			toText(out);
+			return true;
+	}
 }
 
-Logger& Logger::operator<<(ushort input)
+bool Logger::isEnabled() const
 {
-	doIntegerInputMarkup(input, "%u");
-	return *this;
+	return isWritten(*_config, _stream->log_level, _stream->site_state);
 }
 
-Logger& Logger::operator<<(int input)
+bool Logger::isWritten(const Config &config, LogLevel level, int site_state)
 {
-	doIntegerInputMarkup(input, "%d");
-	return *this;
+	if (site_state == SITE_DISABLED) return false;
+
+	if (!config.sinks->empty())
+	{
+		for (SinkList::const_iterator sink = config.sinks->begin(); sink != config.sinks->end(); ++sink)
+			if ((*sink)->accepts(level)) return true;
+		return false;
+	}
+
+	if (site_state == SITE_ENABLED) return true;
+	if (getSeverity(level) < getSeverity(config.level)) return false;
+
+	return config.log_to_file || level == LOG_WARN || level == LOG_ERROR
+			|| (level == LOG_DEBUG && (config.debug || !config.quiet)) || (level == LOG_INFO && !config.quiet);
 }
 
-Logger& Logger::operator<<(long unsigned int input)
+/*
+ * Renders the record at most once per layout and hands the same string to
+ * every sink that accepts the level
+ */
+void Logger::dispatch()
 {
-	doIntegerInputMarkup(input, "%lu");
-	return *this;
+	const LogLevel level = _stream->log_level;
+
+	std::string records[LAYOUT_TRACE + 1];
+	int rendered = 0, renderable = 0;
+	const LogSink::Origin origin = { _stream->time, _stream->file, _stream->line };
+
+	for (SinkList::const_iterator sink = _config->sinks->begin(); sink != _config->sinks->end(); ++sink)
+	{
+		if (!(*sink)->accepts(level)) continue;
+
+		const LogLayout layout = (*sink)->getLayout();
+		if (!(rendered & (1 << layout)))
+		{
+			if (render(layout, records[layout])) renderable |= 1 << layout;
+			rendered |= 1 << layout;
+		}
+
+		if (renderable & (1 << layout)) (*sink)->write(level, records[layout], origin);
+	}
 }
 
-Logger& Logger::operator<<(long input)
+/*
+ * Keeps the record in this thread's crash ring, whether it is written or not
+ */
+void Logger::capture() const
 {
-	doIntegerInputMarkup(input, "%ld");
-	return *this;
+	static thread_local std::string record;
+	record.clear();
+
+	if (!(_config->layouts & (1 << LAYOUT_TEXT)))
+	{
+		record += getLevelDescr(_stream->log_level);
+		record += '\t';
+	}
+
+	record.append(_stream->buffer.data(), _stream->buffer.size());
+	record += _stream->fields_text;
+	CrashRing::record(record.data(), record.length());
 }
 
-Logger& Logger::operator<<(float input)
+/*
+ * Last record of a thread that was written, and the repeats of it that were
+ * not
+ */
+struct Logger::Repeated
 {
-	doRealInputMarkup(input, "f");
-	return *this;
-}
+	bool active;
+	uint64_t hash;
+	LogLevel level;
+	std::string file;
+	int line;
+	int site_state;
+	long thread;
+	std::string context; // rendered LogContext of the thread
+	std::string message;
+	std::string fields_text;
+	std::string fields_json;
+
+	timeval written; // the coalescing window starts here
+	unsigned long count;
+	timeval first;
+	timeval last;
+
+	Repeated() :
+			active(false), hash(0), level(LOG_INFO), line(0), site_state(SITE_DEFAULT), thread(0), count(0)
+	{
+	}
+
+	/*
+	 * Whether the record is the one kept, beyond having the same hash
+	 */
+	bool matches(const Stream &stream, const char* text, size_t length) const
+	{
+		return stream.line == line && stream.log_level == level && length == message.length()
+				&& memcmp(text, message.data(), length) == 0 && stream.file == file && stream.fields_text == fields_text
+				&& stream.fields_json == fields_json;
+	}
 
-Logger& Logger::operator<<(double input)
+	void report() const;
+};
+
+/*
+ * The repeats of a thread, which the RepeatWriter reports when their window
+ * has passed or the thread exits
+ */
+struct Logger::Repeats: Repeated
 {
-	doRealInputMarkup(input, "f");
-	return *this;
+	std::mutex mutex;
+	std::atomic<int64_t> due; // steady milliseconds the window ends, 0 without repeats
+
+	Repeats();
+	~Repeats();
+
+	/*
+	 * Hands the repeats over to be reported, with the mutex held. They are
+	 * reported without it, a sink may log.
+	 */
+	bool take(Repeated &pending)
+	{
+		if (!active || count == 0) return false;
+
+		pending = *this;
+		count = 0;
+		due.store(0);
+		return true;
+	}
+
+	void schedule();
+};
+
+Logger::Repeats& Logger::getRepeats()
+{
+	static thread_local Repeats repeats;
+	return repeats;
 }
 
-Logger& Logger::operator<<(bool input)
+/*
+ * FNV-1a
+ */
+static inline uint64_t hashBytes(uint64_t hash, const char* data, size_t length)
 {
-	if (input)
-		*this << "true";
-	else
-		*this << "false";
-	return *this;
+	for (size_t i = 0; i < length; ++i)
+	{
+		hash ^= (unsigned char) data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
 }
 
-Logger& Logger::operator<<(const cv::Point& input)
+static std::string formatTime(const timeval &time)
 {
-	*this << "(" << input.x << ";" << input.y << ")";
-	return *this;
+	tm tm_buf;
+	const time_t seconds = time.tv_sec;
+	localtime_r(&seconds, &tm_buf);
+
+	char buffer[16];
+	snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d.%03d", tm_buf.tm_hour, tm_buf.tm_min, tm_buf.tm_sec,
+			(int) (time.tv_usec / 1000));
+	return buffer;
 }
 
-Logger& Logger::operator<<(const cv::Size& input)
+static int64_t getSteadyTime()
 {
-	*this << "w:" << input.width << " x h:" << input.height;
-	return *this;
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-Logger& Logger::operator<<(const cv::Scalar& input)
+/*
+ * Written as a record of the thread and the context that logged the
+ * repeated one, also by the RepeatWriter
+ */
+void Logger::Repeated::report() const
 {
-	for (int i = 0; i < input.channels; i++)
-		*this << input[i] << ",";
-	return *this;
+	if (!active || count == 0) return;
+
+	Logger summary(level);
+	summary._stream->site_state = site_state;
+	summary._stream->repeat_summary = true;
+	summary._stream->thread = thread;
+	summary.begin(file, line, context, fields_json);
+	summary << message << " (repeated " << count << " times, " << formatTime(first) << " - " << formatTime(last)
+			<< ")";
+	summary._stream->fields_text = fields_text;
 }
 
-Logger& Logger::operator<<(const cv::Rect& input)
+void Logger::flushRepeats()
 {
-	*this << input.x << "," << input.y << ":" << input.width << "x" << input.height;
-	return *this;
+	Repeats &r = getRepeats();
+	Repeated pending;
+	{
+		std::lock_guard<std::mutex> lock(r.mutex);
+		if (!r.take(pending)) return;
+	}
+	pending.report();
 }
 
-Logger& Logger::operator<<(const cv::Range& range)
+/*
+ * Returns true if the record repeats the last one of this thread within the
+ * window and is not to be written. Otherwise the repeats of the last record,
+ * if any, are reported first.
+ */
+bool Logger::coalesce()
 {
-	bool s = _singular;
-	_singular = true;
-	*this << range.start << "<->" << range.end << " (" << range.size() << ")";
-	_singular = s;
-	return *this;
+	// the text of deferred matrices is not known yet
+	if (_stream->trace || _stream->repeat_summary || !_stream->deferred.empty()) return false;
+
+	const char* message = _stream->buffer.data() + _stream->message_offset;
+	const size_t length = _stream->buffer.size() - _stream->message_offset;
+
+	uint64_t hash = 14695981039346656037ULL;
+	hash = hashBytes(hash, _stream->file.data(), _stream->file.length());
+	hash = hashBytes(hash, (const char*) &_stream->line, sizeof(_stream->line));
+	hash = hashBytes(hash, (const char*) &_stream->log_level, sizeof(_stream->log_level));
+	hash = hashBytes(hash, message, length);
+	hash = hashBytes(hash, _stream->fields_text.data(), _stream->fields_text.length());
+	hash = hashBytes(hash, _stream->fields_json.data(), _stream->fields_json.length());
+
+	Repeats &r = getRepeats();
+	std::unique_lock<std::mutex> lock(r.mutex);
+	const timeval &time = _stream->time;
+	const long elapsed = (time.tv_sec - r.written.tv_sec) * 1000 + (time.tv_usec - r.written.tv_usec) / 1000;
+	const long window = (long) _config->coalesce_window;
+
+	// a hash collision is not a repeat
+	if (r.active && r.hash == hash && elapsed < window && r.matches(*_stream, message, length))
+	{
+		r.last = time;
+		if (r.count++ > 0) return true;
+
+		// the first repeat, reported when the window ends unless a record comes first
+		r.first = time;
+		r.due.store(getSteadyTime() + window - elapsed);
+		lock.unlock();
+		r.schedule();
+		return true;
+	}
+
+	Repeated pending;
+	const bool repeated = r.take(pending);
+
+	r.active = true;
+	r.hash = hash;
+	r.level = _stream->log_level;
+	r.file = _stream->file;
+	r.line = _stream->line;
+	r.site_state = _stream->site_state;
+	r.thread = getThreadId();
+	r.context = LogContext::getTags().text;
+	r.message.assign(message, length);
+	r.fields_text = _stream->fields_text;
+	r.fields_json = _stream->fields_json;
+	r.written = time;
+	lock.unlock();
+
+	if (repeated) pending.report();
+	return false;
 }
 
-Logger& Logger::operator<<(const cv::Mat& mat)
+void Logger::output()
 {
-	bool s = _singular;
-	_singular = false;
-	_matrix_type = mat.type();
+	// a module level overrides Level, Quiet and Debug
+	const bool forced = _stream->site_state == SITE_ENABLED;
+	if (!forced && getSeverity(_stream->log_level) < getSeverity(_config->level)) return;
 
-	switch (_matrix_type)
+	if (_config->output_layout != LAYOUT_TEXT)
 	{
-		case CV_8U:
-		{
-			cv::Mat_<uchar> type = mat;
-			*this << type;
-			break;
-		}
-		case CV_8UC2:
-		{
-			cv::Mat_<cv::Vec2b> type = mat;
-			*this << type;
-			break;
-		}
-		case CV_8UC3:
-		{
-			cv::Mat_<cv::Vec3b> type = mat;
-			*this << type;
-			break;
-		}
-		case CV_8UC4:
-		{
-			cv::Mat_<cv::Vec4b> type = mat;
-			*this << type;
-			break;
-		}
-		case CV_16U:
-		{
-			cv::Mat_<ushort> type = mat;
-			*this << type;
-			break;
-		}
-		case CV_16S:
-		{
-			cv::Mat_<short> type = mat;
-			*this << type;
-			break;
-		}
-		case CV_32S:
-		{
-			cv::Mat_<int> type = mat;
-			*this << type;
-			break;
-		}
-		case CV_32SC2:
-		{
-			cv::Mat_<cv::Vec2i> type = mat;
-			*this << type;
-			break;
-		}
-		case CV_32SC3:
-		{
-			cv::Mat_<cv::Vec3i> type = mat;
-			*this << type;
-			break;
-		}
-		case CV_32SC4:
-		{
-			cv::Mat_<cv::Vec4i> type = mat;
-			*this << type;
-			break;
-		}
-		case CV_32F:
+		const bool enabled = forced || _stream->log_level >= LOG_WARN
+				|| (_stream->log_level == LOG_DEBUG && (_config->debug || !_config->quiet))
+				|| (_stream->log_level == LOG_INFO && !_config->quiet);
+		if (!enabled) return;
+
+		static thread_local std::string record;
+		record.clear();
+		if (!render(_config->output_layout, record)) return;
+
+		std::ostream &out = _stream->log_level >= LOG_WARN ? std::cerr : _stream->log_level == LOG_DEBUG ? std::clog : std::cout;
+		out << record << std::endl;
+		return;
+	}
+
+	const MessageBuffer &input = _stream->buffer;
+
+	if (_stream->log_level > LOG_WARN)
+	{
+		if (_config->color) std::cerr << Color_RED;
+		std::cerr.write(input.data(), input.size()) << std::endl;
+		if (_config->color) std::cerr << Color_RESET;
+	}
+	else if (_stream->log_level == LOG_WARN)
+	{
+		if (_config->color) std::cerr << Color_YELLOW;
+		std::cerr.write(input.data(), input.size()) << std::endl;
+		if (_config->color) std::cerr << Color_RESET;
+	}
+	else if (_stream->log_level == LOG_DEBUG && (forced || _config->debug || !_config->quiet))
+	{
+		if (_config->color) std::clog << Color_CYAN;
+		std::clog.write(input.data(), input.size()) << std::endl;
+		if (_config->color) std::clog << Color_RESET;
+	}
+	else if (_stream->log_level == LOG_INFO && (forced || !_config->quiet))
+	{
+		std::cout.write(input.data(), input.size()) << std::endl;
+		if (_config->color) std::cout << Color_RESET;
+	}
+}
+
+/*
+ * The log-file of the console/file output, shared by all records. It is
+ * opened by the first record written to it, and again when LogFileName
+ * changes.
+ */
+struct LogFile
+{
+	std::mutex mutex;
+	std::ofstream file;
+	std::string name;
+
+	static LogFile& get()
+	{
+		static LogFile log_file;
+		return log_file;
+	}
+
+	bool open(const std::string &file_name)
+	{
+		if (file.is_open() && name == file_name) return true;
+
+		if (file.is_open()) file.close();
+		file.clear();
+		name = file_name;
+
+		file.open(name.c_str(), std::ofstream::app);
+		if (!file.is_open())
 		{
-			cv::Mat_<float> type = mat;
-			*this << type;
-			break;
+			boost::filesystem::create_directories(name.substr(0, name.find_last_of("\\/")));
+			file.open(name.c_str(), std::ofstream::app);
 		}
-		case CV_32FC2:
+		return file.is_open();
+	}
+};
+
+void Logger::write()
+{
+	if (_stream->site_state != SITE_ENABLED && getSeverity(_stream->log_level) < getSeverity(_config->level)) return;
+
+	static thread_local std::string record;
+	const bool text = _config->output_layout == LAYOUT_TEXT;
+	if (!text)
+	{
+		record.clear();
+		if (!render(_config->output_layout, record)) return;
+	}
+
+	LogFile &log_file = LogFile::get();
+	std::lock_guard<std::mutex> lock(log_file.mutex);
+
+	if (!log_file.open(_config->log_file_name))
+	{
+		if (_config->color) std::cerr << Color_RED;
+		std::cerr << "Unable to open logfile: " << _config->log_file_name << std::endl;
+		if (_config->color) std::cerr << Color_RESET;
+		return;
+	}
+
+	if (text)
+		log_file.file.write(_stream->buffer.data(), _stream->buffer.size());
+	else
+		log_file.file.write(record.data(), record.length());
+
+	// a record is in the file once written, Flush is implied
+	log_file.file << std::endl;
+}
+
+/*
+ * Writes the record to the sinks, or to the console and the log-file
+ */
+void Logger::deliver()
+{
+	if (!_stream->deferred.empty() && isEnabled()) formatDeferred();
+
+	if (!_config->sinks->empty())
+	{
+		dispatch();
+	}
+	else
+	{
+		output();
+
+		if (isLogToFile()) write();
+	}
+}
+
+/*
+ * Prints the matrices that were logged by reference where they were logged
+ */
+void Logger::formatDeferred()
+{
+	std::vector<std::pair<size_t, cv::Mat> > deferred;
+	deferred.swap(_stream->deferred);
+
+	MessageBuffer &buffer = _stream->buffer;
+	const size_t start = deferred.front().first;
+	const std::string tail(buffer.data() + start, buffer.size() - start);
+	buffer.truncate(start);
+
+	size_t done = start;
+	for (size_t i = 0; i < deferred.size(); ++i)
+	{
+		buffer.append(tail.data() + done - start, deferred[i].first - done);
+		done = deferred[i].first;
+		*this << deferred[i].second;
+	}
+	buffer.append(tail.data() + done - start, tail.length() - (done - start));
+}
+
+/*
+ * Thread that writes the records of all threads with AsyncQueue, in the
+ * order in which they were queued. What is still queued when the program
+ * exits is written first.
+ */
+struct Logger::Backend
+{
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::condition_variable room;
+	std::condition_variable idle;
+	std::deque<std::pair<Stream*, const Config*> > records;
+	const Config* writing; // snapshot of the record being written
+	std::thread worker;
+	bool stop;
+	bool busy;
+
+	unsigned long dropped[LOG_ERROR + 1]; // since the start
+	unsigned long unreported[LOG_ERROR + 1]; // since the last summary
+
+	Backend() :
+			writing(NULL), stop(false), busy(false)
+	{
+		std::fill(dropped, dropped + LOG_ERROR + 1, 0);
+		std::fill(unreported, unreported + LOG_ERROR + 1, 0);
+	}
+
+	~Backend()
+	{
 		{
-			cv::Mat_<cv::Vec2f> type = mat;
-			*this << type;
-			break;
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
 		}
-		case CV_32FC3:
+		ready.notify_all();
+		if (worker.joinable()) worker.join();
+
+		// a FileSink writes the index of its last records when flushed
+		flushSinks();
+	}
+
+	/*
+	 * Whether a record of the level is dropped instead of queued, given the
+	 * number of records in the queue
+	 */
+	static bool isShed(LogLevel level, size_t queued, size_t capacity)
+	{
+		if (level == LOG_DEBUG) return queued >= (capacity + 1) / 2;
+		if (level == LOG_INFO) return queued >= capacity;
+		return false;
+	}
+
+	/*
+	 * Reports the records dropped since the last report, on the backend
+	 */
+	static void report(unsigned long debug, unsigned long info)
+	{
+		create(LOG_WARN, __FILE__, __LINE__) << "records dropped, output could not keep up"
+				<< field("dropped_debug", debug) << field("dropped_info", info);
+	}
+
+	static Backend& get()
+	{
+		// made first so they outlive the records written at exit
+		LogFile::get();
+		getStableLayouts();
+		getConfigMutex();
+
+		static Backend backend;
+		return backend;
+	}
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
 		{
-			cv::Mat_<cv::Vec3f> type = mat;
-			*this << type;
-			break;
+			while (records.empty() && !stop)
+				ready.wait(lock);
+			if (records.empty()) break;
+
+			std::pair<Stream*, const Config*> record = records.front();
+			records.pop_front();
+			writing = record.second;
+			busy = true;
+			lock.unlock();
+			room.notify_one();
+
+			{
+				Logger logger(record.first, record.second);
+				try
+				{
+					logger.deliver();
+				}
+				catch (const std::exception &e)
+				{
+					std::cerr << "Unable to write record: " << e.what() << std::endl;
+				}
+
+				// written, the destructor only deletes it
+				logger._stream->site_state = SITE_DISABLED;
+			}
+
+			lock.lock();
+			writing = NULL;
+			if (record.second != getConfig())
+			{
+				lock.unlock();
+				reclaimConfigs();
+				lock.lock();
+			}
+			if (records.empty() && (unreported[LOG_DEBUG] > 0 || unreported[LOG_INFO] > 0))
+			{
+				const unsigned long debug = unreported[LOG_DEBUG], info = unreported[LOG_INFO];
+				unreported[LOG_DEBUG] = unreported[LOG_INFO] = 0;
+				lock.unlock();
+				report(debug, info);
+				lock.lock();
+			}
+			busy = false;
+			if (records.empty()) idle.notify_all();
 		}
-		case CV_32FC4:
+	}
+};
+
+/*
+ * Must be called with the config mutex held. The former snapshot is retired,
+ * reclaimConfigs() frees it once nobody reads it.
+ */
+void Logger::publish(const Config &config)
+{
+	// flushes the sinks at exit
+	Backend::get();
+
+	Config* next = new Config(config);
+	next->layouts = getLayouts(*next);
+	next->version = getConfig()->version + 1;
+
+	const Config* previous = current_config.load(std::memory_order_relaxed);
+	current_config.store(next);
+	updateSites(*next);
+	if (previous == NULL) return;
+
+	ConfigPins &pins = ConfigPins::get();
+	std::lock_guard<std::mutex> lock(pins.mutex);
+	pins.retired.push_back(previous);
+}
+
+/*
+ * Hands the record over to the backend, which deletes it once written.
+ * Records logged on the backend itself, by a sink say, are written at once.
+ */
+void Logger::post()
+{
+	Backend &backend = Backend::get();
+	std::unique_lock<std::mutex> lock(backend.mutex);
+
+	if (backend.worker.get_id() == std::this_thread::get_id())
+	{
+		lock.unlock();
+		deliver();
+		delete _stream;
+		return;
+	}
+
+	if (!backend.worker.joinable()) backend.worker = std::thread(&Backend::run, &backend);
+
+	const LogLevel level = _stream->log_level;
+	if (Backend::isShed(level, backend.records.size(), _config->async_queue))
+	{
+		++backend.dropped[level];
+		++backend.unreported[level];
+		lock.unlock();
+		delete _stream;
+		return;
+	}
+
+	while (backend.records.size() >= _config->async_queue)
+		backend.room.wait(lock);
+
+	// repeat counts are reported for the thread that logged the record
+	if (_stream->thread == 0) _stream->thread = getThreadId();
+	backend.records.push_back(std::make_pair(_stream, _config));
+	lock.unlock();
+	backend.ready.notify_one();
+}
+
+/*
+ * Thread that reports the repeats of the threads whose window has passed,
+ * and of the threads that exited before they were reported. At exit all
+ * repeats are reported.
+ */
+struct Logger::RepeatWriter
+{
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::vector<Repeats*> threads;
+	std::deque<Repeated> orphans; // of threads that exited
+	std::thread worker;
+	bool stop;
+
+	RepeatWriter() :
+			stop(false)
+	{
+	}
+
+	~RepeatWriter()
+	{
 		{
-			cv::Mat_<cv::Vec4f> type = mat;
-			*this << type;
-			break;
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
 		}
-		case CV_64F:
+		ready.notify_all();
+		if (worker.joinable()) worker.join();
+	}
+
+	static RepeatWriter& get()
+	{
+		// made first so they outlive the reports written at exit
+		Backend::get();
+		getDefaultConfig();
+
+		static RepeatWriter writer;
+		return writer;
+	}
+
+	/*
+	 * With the mutex held
+	 */
+	void wake()
+	{
+		if (!worker.joinable()) worker = std::thread(&RepeatWriter::run, this);
+		ready.notify_one();
+	}
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
 		{
-			cv::Mat_<double> type = mat;
-			*this << type;
-			break;
+			while (!orphans.empty())
+			{
+				const Repeated orphan = orphans.front();
+				orphans.pop_front();
+				lock.unlock();
+				orphan.report();
+				lock.lock();
+			}
+
+			Repeats* next = NULL;
+			int64_t next_due = 0;
+			for (size_t t = 0; t < threads.size(); ++t)
+			{
+				const int64_t due = threads[t]->due.load();
+				if (due != 0 && (next == NULL || due < next_due))
+				{
+					next = threads[t];
+					next_due = due;
+				}
+			}
+
+			const int64_t now = getSteadyTime();
+			if (next != NULL && (stop || next_due <= now))
+			{
+				// the thread may have reported them itself meanwhile
+				Repeated pending;
+				bool repeated;
+				{
+					std::lock_guard<std::mutex> thread_lock(next->mutex);
+					const int64_t due = next->due.load();
+					repeated = due != 0 && (stop || due <= now) && next->take(pending);
+				}
+				lock.unlock();
+				if (repeated) pending.report();
+				lock.lock();
+				continue;
+			}
+
+			if (stop) break;
+			if (next == NULL)
+				ready.wait(lock);
+			else
+				ready.wait_for(lock, std::chrono::milliseconds(next_due - now));
 		}
-		case CV_64FC2:
+	}
+};
+
+Logger::Repeats::Repeats() :
+		due(0)
+{
+	RepeatWriter &writer = RepeatWriter::get();
+	std::lock_guard<std::mutex> lock(writer.mutex);
+	writer.threads.push_back(this);
+}
+
+/*
+ * Repeats that were not reported yet are handed to the RepeatWriter, the
+ * thread cannot write them itself once its thread_local state is going
+ */
+Logger::Repeats::~Repeats()
+{
+	RepeatWriter &writer = RepeatWriter::get();
+	std::lock_guard<std::mutex> lock(writer.mutex);
+	writer.threads.erase(std::find(writer.threads.begin(), writer.threads.end(), this));
+
+	std::lock_guard<std::mutex> own(mutex);
+	Repeated pending;
+	if (!take(pending)) return;
+
+	writer.orphans.push_back(pending);
+	writer.wake();
+}
+
+/*
+ * Lets the RepeatWriter know of a window that ends, without the mutex held
+ */
+void Logger::Repeats::schedule()
+{
+	RepeatWriter &writer = RepeatWriter::get();
+	std::lock_guard<std::mutex> lock(writer.mutex);
+	writer.wake();
+}
+
+/*
+ * Frees the retired snapshots that no thread has pinned and no queued record
+ * refers to. The snapshots are deleted after the locks are released, as the
+ * sinks they may take with them can log while they are destroyed.
+ */
+void Logger::reclaimConfigs()
+{
+	std::vector<const Config*> unused;
+	{
+		ConfigPins &pins = ConfigPins::get();
+		std::lock_guard<std::mutex> lock(pins.mutex);
+		if (pins.retired.empty()) return;
+
+		std::set<const Config*> held;
+		for (size_t p = 0; p < pins.pins.size(); ++p)
 		{
-			cv::Mat_<cv::Vec2d> type = mat;
-			*this << type;
-			break;
+			held.insert(pins.pins[p]->logger.load());
+			held.insert(pins.pins[p]->read.load());
 		}
-		case CV_64FC3:
+
+		Backend &backend = Backend::get();
+		std::lock_guard<std::mutex> backend_lock(backend.mutex);
+		for (size_t r = 0; r < backend.records.size(); ++r)
+			held.insert(backend.records[r].second);
+		held.insert(backend.writing);
+
+		std::vector<const Config*> retired;
+		for (size_t r = 0; r < pins.retired.size(); ++r)
+			(held.count(pins.retired[r]) ? retired : unused).push_back(pins.retired[r]);
+		pins.retired.swap(retired);
+	}
+
+	for (size_t u = 0; u < unused.size(); ++u)
+		delete unused[u];
+}
+
+void Logger::flushQueue()
+{
+	Backend &backend = Backend::get();
+	std::unique_lock<std::mutex> lock(backend.mutex);
+	while (!backend.records.empty() || backend.busy)
+		backend.idle.wait(lock);
+}
+
+unsigned long Logger::getDropped(LogLevel level)
+{
+	Backend &backend = Backend::get();
+	std::lock_guard<std::mutex> lock(backend.mutex);
+	return backend.dropped[level];
+}
+
+Logger& Logger::operator<<(const cv::Point& input)
+{
+	*this << "(" << input.x << ";" << input.y << ")";
+	return *this;
+}
+
+Logger& Logger::operator<<(const cv::Size& input)
+{
+	*this << "w:" << input.width << " x h:" << input.height;
+	return *this;
+}
+
+Logger& Logger::operator<<(const cv::Scalar& input)
+{
+	for (int i = 0; i < input.channels; i++)
+		*this << input[i] << ",";
+	return *this;
+}
+
+Logger& Logger::operator<<(const cv::Rect& input)
+{
+	*this << input.x << "," << input.y << ":" << input.width << "x" << input.height;
+	return *this;
+}
+
+Logger& Logger::operator<<(const cv::Range& range)
+{
+	bool s = _singular;
+	_singular = true;
+	*this << range.start << "<->" << range.end << " (" << range.size() << ")";
+	_singular = s;
+	return *this;
+}
+
+Logger& Logger::operator<<(const cv::Mat& mat)
+{
+	bool s = _singular;
+	_singular = false;
+	_matrix_type = mat.type();
+
+	const int depth = mat.depth();
+	const int channels = mat.channels();
+
+	if (depth < MatDepths)
+	{
+		(this->*MatPrinters[depth][channels <= MatVecChannels ? channels : 0])(mat);
+	}
+	else
+	{
+		// no primitive to print half floats (CV_16F) and the depths of OpenCV 5 with, widen them to CV_32F
+		cv::Mat widened;
+		mat.convertTo(widened, CV_32F);
+		(this->*MatPrinters[CV_32F][channels <= MatVecChannels ? channels : 0])(widened);
+	}
+
+	_singular = s;
+	return *this;
+}
+
+bool Logger::LayoutKey::operator<(const LayoutKey &other) const
+{
+	if (line != other.line) return line < other.line;
+	if (type != other.type) return type < other.type;
+	if (rows != other.rows) return rows < other.rows;
+	if (cols != other.cols) return cols < other.cols;
+	if (precision != other.precision) return precision < other.precision;
+	return file < other.file;
+}
+
+static std::mutex layout_mutex;
+
+Logger::LayoutMap& Logger::getStableLayouts()
+{
+	static LayoutMap layouts;
+	return layouts;
+}
+
+bool Logger::getStableLayout(const LayoutKey &key, std::vector<std::vector<size_t> > &widths)
+{
+	std::lock_guard<std::mutex> lock(layout_mutex);
+	LayoutMap::const_iterator layout = getStableLayouts().find(key);
+	if (layout == getStableLayouts().end()) return false;
+
+	widths = layout->second;
+	return true;
+}
+
+/*
+ * Widths only grow, also when another thread logged wider values meanwhile
+ */
+void Logger::putStableLayout(const LayoutKey &key, const std::vector<std::vector<size_t> > &widths)
+{
+	std::lock_guard<std::mutex> lock(layout_mutex);
+	std::vector<std::vector<size_t> > &layout = getStableLayouts()[key];
+	if (layout.size() != widths.size())
+	{
+		layout = widths;
+		return;
+	}
+
+	for (size_t x = 0; x < widths.size(); ++x)
+		for (size_t c = 0; c < widths[x].size() && c < layout[x].size(); ++c)
+			layout[x][c] = MAX(layout[x][c], widths[x][c]);
+}
+
+/*
+ * Last logged value of a tracked matrix, as one CV_64F channel, and the
+ * type and shape it was logged with
+ */
+struct DeltaState
+{
+	cv::Mat values;
+	int type;
+	std::vector<int> sizes;
+};
+
+static std::mutex delta_mutex;
+
+/*
+ * Beyond this many changed elements a delta is summarized as runs
+ */
+static const size_t MaxDeltaElements = 16;
+
+static std::map<std::string, DeltaState>& deltaRegistry()
+{
+	static std::map<std::string, DeltaState> deltas;
+	return deltas;
+}
+
+void Logger::clearDeltas()
+{
+	std::lock_guard<std::mutex> lock(delta_mutex);
+	deltaRegistry().clear();
+}
+
+Logger& Logger::operator<<(const Delta& delta)
+{
+	std::string key;
+	if (delta.tag != NULL)
+	{
+		key = delta.tag;
+	}
+	else
+	{
+		// the call site, and which of its deltas this is
+		std::stringstream site;
+		site << _stream->file << ":" << _stream->line << "#" << _deltas;
+		key = site.str();
+	}
+	++_deltas;
+
+	cv::Mat current;
+	delta.mat.convertTo(current, CV_64F);
+	current = current.reshape(1, 1);
+
+	std::vector<int> sizes(delta.mat.dims);
+	for (int d = 0; d < delta.mat.dims; ++d)
+		sizes[d] = delta.mat.size[d];
+
+	std::unique_lock<std::mutex> lock(delta_mutex);
+	DeltaState &state = deltaRegistry()[key];
+
+	if (state.values.empty() || state.type != delta.mat.type() || state.sizes != sizes)
+	{
+		state.values = current.clone();
+		state.type = delta.mat.type();
+		state.sizes = sizes;
+		lock.unlock();
+
+		// first time, or the shape changed: full dump
+		*this << delta.mat;
+		return *this;
+	}
+
+	// flat indices of the elements that changed, as runs [start, end)
+	std::vector<std::pair<int, int> > runs;
+	double max_change = 0;
+
+	const double* now = current.ptr<double>();
+	double* before = state.values.ptr<double>();
+	const int count = (int) current.total();
+	for (int i = 0; i < count; ++i)
+	{
+		const bool now_nan = now[i] != now[i], before_nan = before[i] != before[i];
+		if (now_nan && before_nan) continue;
+
+		// a change to or from NaN is always reported
+		const double change = std::abs(now[i] - before[i]);
+		if (now_nan == before_nan && !(change > delta.tolerance)) continue;
+
+		if (change > max_change) max_change = change;
+		if (!runs.empty() && runs.back().second == i)
+			runs.back().second = i + 1;
+		else
+			runs.push_back(std::make_pair(i, i + 1));
+	}
+
+	bool s = _singular;
+	_singular = true;
+
+	*this << getMatDepthFromCode(delta.mat.type());
+	if (delta.mat.dims == 2) *this << "(" << delta.mat.rows << "x" << delta.mat.cols << ")";
+
+	size_t total_changed = 0;
+	for (size_t r = 0; r < runs.size(); ++r)
+		total_changed += runs[r].second - runs[r].first;
+
+	if (total_changed == 0)
+	{
+		*this << " unchanged";
+	}
+	else if (total_changed <= MaxDeltaElements)
+	{
+		// element wise: (row,col[,channel]): old -> new
+		*this << " " << (int) total_changed << "/" << count << " changed:";
+		const int channels = delta.mat.channels();
+		for (size_t r = 0; r < runs.size(); ++r)
 		{
-			cv::Mat_<cv::Vec3d> type = mat;
-			*this << type;
-			break;
+			for (int i = runs[r].first; i < runs[r].second; ++i)
+			{
+				*this << " (";
+				if (delta.mat.dims == 2)
+				{
+					const int element = i / channels;
+					*this << element / delta.mat.cols << "," << element % delta.mat.cols;
+					if (channels > 1) *this << "," << i % channels;
+				}
+				else
+				{
+					*this << i;
+				}
+				*this << "): " << before[i] << " -> " << now[i];
+			}
 		}
-		case CV_64FC4:
+	}
+	else
+	{
+		// run-length summary over the flattened elements
+		*this << " " << (int) total_changed << "/" << count << " changed, max |d| " << max_change << ", runs:";
+		for (size_t r = 0; r < runs.size() && r < MaxDeltaElements; ++r)
 		{
-			cv::Mat_<cv::Vec4d> type = mat;
-			*this << type;
-			break;
+			*this << " " << runs[r].first;
+			if (runs[r].second - runs[r].first > 1) *this << "-" << runs[r].second - 1;
 		}
+		if (runs.size() > MaxDeltaElements) *this << " ...";
 	}
 
 	_singular = s;
+
+	// drift below the tolerance accumulates until it exceeds it
+	for (size_t r = 0; r < runs.size(); ++r)
+		for (int i = runs[r].first; i < runs[r].second; ++i)
+			before[i] = now[i];
+
+	return *this;
+}
+
+Logger& Logger::operator<<(const Image& image)
+{
+	// nothing to scale or queue for a record that is not written
+	if (!isEnabled()) return *this;
+
+	const cv::Mat &mat = image.mat;
+	if (mat.empty() || mat.dims != 2 || mat.depth() != CV_8U || mat.channels() == 2 || mat.channels() > 4)
+	{
+		return *this << mat;
+	}
+
+	// downscaling here leaves the worker a small private copy to encode
+	const int max_side = ImageWriter::getMaxSide();
+	const int longest = MAX(mat.rows, mat.cols);
+	cv::Mat thumbnail;
+	if (longest > max_side)
+	{
+		const double scale = max_side / (double) longest;
+		cv::resize(mat, thumbnail, cv::Size(), scale, scale, cv::INTER_AREA);
+	}
+	else
+	{
+		thumbnail = mat.clone();
+	}
+
+	const std::string file_name = ImageWriter::write(thumbnail, image.name);
+	const cv::Scalar mean = cv::mean(thumbnail);
+
+	bool s = _singular;
+	_singular = true;
+
+	*this << getMatDepthFromCode(mat.type()) << "(" << mat.rows << "x" << mat.cols << ") mean(" << mean[0];
+	for (int c = 1; c < mat.channels(); ++c)
+		*this << "," << mean[c];
+	*this << ")";
+
+	if (file_name.empty())
+		*this << " image dropped";
+	else
+		*this << " -> " << file_name;
+
+	_singular = s;
+
+	return *this;
+}
+
+Logger& Logger::operator<<(const MatRef& ref)
+{
+	if (_config->async_queue == 0 || ref.mat.empty()) return *this << ref.mat;
+
+	// without a snapshot the header shares the data of the caller
+	const cv::Mat mat = ref.snapshot ? ref.mat.clone() : ref.mat;
+	_stream->deferred.push_back(std::make_pair(_stream->buffer.size(), mat));
+
 	return *this;
 }
 
@@ -0,0 +1,83 @@
+/*
+ * MessageBuffer.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+#include "MessageBuffer.h"
+
+namespace nl_uu_science_gmt
+{
+
+namespace
+{
+
+/*
+ * Larger blocks are freed instead of kept for the next record
+ */
+const size_t MaxSpareCapacity = 4 * 1024 * 1024;
+
+/*
+ * Heap block left behind by the last large record on this thread
+ */
+struct Spare
+{
+	char* data;
+	size_t capacity;
+
+	Spare() :
+			data(NULL), capacity(0)
+	{
+	}
+
+	~Spare()
+	{
+		delete[] data;
+	}
+};
+
+thread_local Spare spare;
+
+} /* namespace */
+
+MessageBuffer::~MessageBuffer()
+{
+	if (_data == _inline) return;
+
+	if (_capacity > spare.capacity && _capacity <= MaxSpareCapacity)
+	{
+		delete[] spare.data;
+		spare.data = _data;
+		spare.capacity = _capacity;
+	}
+	else
+	{
+		delete[] _data;
+	}
+}
+
+void MessageBuffer::grow(size_t required)
+{
+	size_t capacity = _capacity * 2;
+	if (capacity < required) capacity = required;
+
+	char* data;
+	if (spare.capacity >= capacity)
+	{
+		data = spare.data;
+		capacity = spare.capacity;
+		spare.data = NULL;
+		spare.capacity = 0;
+	}
+	else
+	{
+		data = new char[capacity];
+	}
+
+	memcpy(data, _data, _size);
+	if (_data != _inline) delete[] _data;
+
+	_data = data;
+	_capacity = capacity;
+}
+
+} /* namespace nl_uu_science_gmt */
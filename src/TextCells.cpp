@@ -0,0 +1,302 @@
+/*
+ * TextCells.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+#include "TextCells.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TEXTCELLS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace nl_uu_science_gmt
+{
+
+std::atomic<bool> TextCells::_enabled(true);
+
+namespace
+{
+
+const char DigitPairs[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+		"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+		"8081828384858687888990919293949596979899";
+
+/*
+ * Writes the digits of the value backwards from end, returns their number
+ */
+inline size_t writeDigits(uint64_t value, char* end)
+{
+	char* p = end;
+	while (value >= 100)
+	{
+		const size_t pair = (value % 100) * 2;
+		value /= 100;
+		*--p = DigitPairs[pair + 1];
+		*--p = DigitPairs[pair];
+	}
+	if (value >= 10)
+	{
+		*--p = DigitPairs[value * 2 + 1];
+		*--p = DigitPairs[value * 2];
+	}
+	else
+	{
+		*--p = (char) ('0' + value);
+	}
+	return end - p;
+}
+
+template<typename T>
+inline void formatIntegers(const T* values, size_t count, size_t slot, char* text, uint8_t* length)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		char* end = text + (i + 1) * slot;
+		const long value = values[i];
+		size_t digits = writeDigits(value < 0 ? -(uint64_t) value : value, end);
+		if (value < 0) end[-(long) ++digits] = '-';
+		length[i] = (uint8_t) digits;
+	}
+}
+
+/*
+ * 8-bit values into 4 byte slots " hto", blanks for leading zeros
+ */
+inline void formatByte(unsigned char value, char* slot, uint8_t &length)
+{
+	const int h = value / 100, t = value / 10 % 10, o = value % 10;
+	slot[0] = ' ';
+	slot[1] = h ? (char) ('0' + h) : ' ';
+	slot[2] = h || t ? (char) ('0' + t) : ' ';
+	slot[3] = (char) ('0' + o);
+	length = (uint8_t) (h ? 3 : t ? 2 : 1);
+}
+
+typedef size_t (*ByteKernel)(const unsigned char*, size_t, char*, uint8_t*);
+
+#ifdef TEXTCELLS_X86
+
+/*
+ * Digits of 8 values widened to 16 bits: x / 100 == (x * 41) >> 12 and
+ * x / 10 == (x * 103) >> 10 for the ranges involved
+ */
+inline void splitDigits(__m128i x, __m128i &h, __m128i &t, __m128i &o)
+{
+	h = _mm_srli_epi16(_mm_mullo_epi16(x, _mm_set1_epi16(41)), 12);
+	const __m128i r = _mm_sub_epi16(x, _mm_mullo_epi16(h, _mm_set1_epi16(100)));
+	t = _mm_srli_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(103)), 10);
+	o = _mm_sub_epi16(r, _mm_mullo_epi16(t, _mm_set1_epi16(10)));
+}
+
+size_t formatBytesSSE2(const unsigned char* values, size_t count, char* text, uint8_t* length)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i blank = _mm_set1_epi8(' ');
+	const __m128i digit = _mm_set1_epi8('0');
+	const __m128i three = _mm_set1_epi8(3);
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m128i v = _mm_loadu_si128((const __m128i*) (values + i));
+		__m128i h_lo, t_lo, o_lo, h_hi, t_hi, o_hi;
+		splitDigits(_mm_unpacklo_epi8(v, zero), h_lo, t_lo, o_lo);
+		splitDigits(_mm_unpackhi_epi8(v, zero), h_hi, t_hi, o_hi);
+		const __m128i h = _mm_packus_epi16(h_lo, h_hi);
+		const __m128i t = _mm_packus_epi16(t_lo, t_hi);
+		const __m128i o = _mm_packus_epi16(o_lo, o_hi);
+
+		const __m128i no_h = _mm_cmpeq_epi8(h, zero);
+		const __m128i no_t = _mm_and_si128(no_h, _mm_cmpeq_epi8(t, zero));
+		const __m128i c2 = _mm_or_si128(_mm_and_si128(no_h, blank), _mm_andnot_si128(no_h, _mm_add_epi8(h, digit)));
+		const __m128i c1 = _mm_or_si128(_mm_and_si128(no_t, blank), _mm_andnot_si128(no_t, _mm_add_epi8(t, digit)));
+		const __m128i c0 = _mm_add_epi8(o, digit);
+
+		// the masks are -1 where a digit is left out
+		_mm_storeu_si128((__m128i*) (length + i), _mm_add_epi8(three, _mm_add_epi8(no_h, no_t)));
+
+		const __m128i a_lo = _mm_unpacklo_epi8(blank, c2), a_hi = _mm_unpackhi_epi8(blank, c2);
+		const __m128i b_lo = _mm_unpacklo_epi8(c1, c0), b_hi = _mm_unpackhi_epi8(c1, c0);
+		__m128i* out = (__m128i*) (text + i * 4);
+		_mm_storeu_si128(out + 0, _mm_unpacklo_epi16(a_lo, b_lo));
+		_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(a_lo, b_lo));
+		_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(a_hi, b_hi));
+		_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(a_hi, b_hi));
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+inline void splitDigitsAVX2(__m256i x, __m256i &h, __m256i &t, __m256i &o)
+{
+	h = _mm256_srli_epi16(_mm256_mullo_epi16(x, _mm256_set1_epi16(41)), 12);
+	const __m256i r = _mm256_sub_epi16(x, _mm256_mullo_epi16(h, _mm256_set1_epi16(100)));
+	t = _mm256_srli_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(103)), 10);
+	o = _mm256_sub_epi16(r, _mm256_mullo_epi16(t, _mm256_set1_epi16(10)));
+}
+
+__attribute__((target("avx2")))
+size_t formatBytesAVX2(const unsigned char* values, size_t count, char* text, uint8_t* length)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i blank = _mm256_set1_epi8(' ');
+	const __m256i digit = _mm256_set1_epi8('0');
+	const __m256i three = _mm256_set1_epi8(3);
+
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32)
+	{
+		const __m128i v_lo = _mm_loadu_si128((const __m128i*) (values + i));
+		const __m128i v_hi = _mm_loadu_si128((const __m128i*) (values + i + 16));
+		__m256i h_lo, t_lo, o_lo, h_hi, t_hi, o_hi;
+		splitDigitsAVX2(_mm256_cvtepu8_epi16(v_lo), h_lo, t_lo, o_lo);
+		splitDigitsAVX2(_mm256_cvtepu8_epi16(v_hi), h_hi, t_hi, o_hi);
+
+		// packing works per 128-bit lane, restore the order of the values
+		const __m256i h = _mm256_permute4x64_epi64(_mm256_packus_epi16(h_lo, h_hi), 0xD8);
+		const __m256i t = _mm256_permute4x64_epi64(_mm256_packus_epi16(t_lo, t_hi), 0xD8);
+		const __m256i o = _mm256_permute4x64_epi64(_mm256_packus_epi16(o_lo, o_hi), 0xD8);
+
+		const __m256i no_h = _mm256_cmpeq_epi8(h, zero);
+		const __m256i no_t = _mm256_and_si256(no_h, _mm256_cmpeq_epi8(t, zero));
+		const __m256i c2 = _mm256_blendv_epi8(_mm256_add_epi8(h, digit), blank, no_h);
+		const __m256i c1 = _mm256_blendv_epi8(_mm256_add_epi8(t, digit), blank, no_t);
+		const __m256i c0 = _mm256_add_epi8(o, digit);
+
+		_mm256_storeu_si256((__m256i*) (length + i), _mm256_add_epi8(three, _mm256_add_epi8(no_h, no_t)));
+
+		// slots 0-3 and 16-19 in s0, 4-7 and 20-23 in s1, ..
+		const __m256i a_lo = _mm256_unpacklo_epi8(blank, c2), a_hi = _mm256_unpackhi_epi8(blank, c2);
+		const __m256i b_lo = _mm256_unpacklo_epi8(c1, c0), b_hi = _mm256_unpackhi_epi8(c1, c0);
+		const __m256i s0 = _mm256_unpacklo_epi16(a_lo, b_lo), s1 = _mm256_unpackhi_epi16(a_lo, b_lo);
+		const __m256i s2 = _mm256_unpacklo_epi16(a_hi, b_hi), s3 = _mm256_unpackhi_epi16(a_hi, b_hi);
+
+		__m256i* out = (__m256i*) (text + i * 4);
+		_mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(s0, s1, 0x20));
+		_mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(s2, s3, 0x20));
+		_mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(s0, s1, 0x31));
+		_mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(s2, s3, 0x31));
+	}
+	return i;
+}
+
+ByteKernel selectByteKernel()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? formatBytesAVX2 : formatBytesSSE2;
+}
+
+#else
+
+size_t formatBytesNone(const unsigned char*, size_t, char*, uint8_t*)
+{
+	return 0;
+}
+
+ByteKernel selectByteKernel()
+{
+	return formatBytesNone;
+}
+
+#endif
+
+} /* namespace */
+
+void TextCells::resize(size_t count, size_t slot)
+{
+	_slot = slot;
+	if (_text.size() < count * slot) _text.resize(count * slot);
+	if (_length.size() < count) _length.resize(count);
+}
+
+bool TextCells::format(const unsigned char* values, size_t count)
+{
+	if (!isEnabled()) return false;
+	resize(count, 4);
+
+	static const ByteKernel kernel = selectByteKernel();
+	size_t i = kernel(values, count, &_text[0], &_length[0]);
+	for (; i < count; ++i)
+		formatByte(values[i], &_text[i * 4], _length[i]);
+	return true;
+}
+
+bool TextCells::format(const signed char* values, size_t count)
+{
+	if (!isEnabled()) return false;
+	resize(count, 4);
+	formatIntegers(values, count, _slot, &_text[0], &_length[0]);
+	return true;
+}
+
+bool TextCells::format(const unsigned short* values, size_t count)
+{
+	if (!isEnabled()) return false;
+	resize(count, 8);
+	formatIntegers(values, count, _slot, &_text[0], &_length[0]);
+	return true;
+}
+
+bool TextCells::format(const short* values, size_t count)
+{
+	if (!isEnabled()) return false;
+	resize(count, 8);
+	formatIntegers(values, count, _slot, &_text[0], &_length[0]);
+	return true;
+}
+
+bool TextCells::format(const int* values, size_t count)
+{
+	if (!isEnabled()) return false;
+	resize(count, 12);
+	formatIntegers(values, count, _slot, &_text[0], &_length[0]);
+	return true;
+}
+
+/*
+ * A float times 10^precision is exact in a double for a precision up to 9
+ * (the significands take at most 24 + 21 bits), so rounding it to an
+ * integer rounds like printf does
+ */
+bool TextCells::format(const float* values, size_t count, int precision)
+{
+	static const double Scales[] = { 1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+	static const uint64_t Divisors[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+	if (!isEnabled() || precision < 0 || precision > 9) return false;
+	resize(count, 24);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const double value = values[i];
+		const double scaled = std::fabs(value) * Scales[precision];
+		if (!(scaled < 1e18))
+		{
+			_length[i] = 0;
+			continue;
+		}
+
+		const uint64_t rounded = (uint64_t) std::nearbyint(scaled);
+		char* end = &_text[(i + 1) * _slot];
+		char* p = end;
+
+		if (precision > 0)
+		{
+			uint64_t fraction = rounded % Divisors[precision];
+			for (int d = 0; d < precision; ++d, fraction /= 10)
+				*--p = (char) ('0' + fraction % 10);
+			*--p = '.';
+		}
+		p -= writeDigits(rounded / Divisors[precision], p);
+		if (std::signbit(value)) *--p = '-';
+
+		_length[i] = (uint8_t) (end - p);
+	}
+	return true;
+}
+
+} /* namespace nl_uu_science_gmt */
@@ -0,0 +1,1035 @@
+/*
+ * LoggerTests.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *
+ * Correctness and performance regression tests, run by ctest.
+ *
+ * Matrix output in every LogFormat is compared against the golden file,
+ * and a missing golden file fails the test. Only "logger_tests --update"
+ * writes it: run it on a reference build after an intended change of
+ * output, and commit the result. Its values are small integers and eighths,
+ * which OpenCV converts and compares exactly, so it does not depend on the
+ * OpenCV version. Scalar, container and OpenCV type output is checked
+ * against literal expectations. The number of allocations per line is
+ * bounded; the time per scalar token only with --performance (ctest -C
+ * Performance), its limit can be set with LOGGER_TESTS_MAX_NS_PER_TOKEN.
+ */
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <boost/filesystem/operations.hpp>
+
+#include "ImageWriter.h"
+#include "Logger.h"
+#include "LogContext.h"
+#include "LogScope.h"
+#include "LogSink.h"
+
+using namespace nl_uu_science_gmt;
+
+/*
+ * Allocations made through the global operator new, by this test and by
+ * the library
+ */
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size == 0 ? 1 : size);
+	if (p == NULL) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+static int failures = 0;
+
+#define CHECK(condition, message) \
+	do { if (!(condition)) { ++failures; std::cerr << __FILE__ << ":" << __LINE__ << ": " << message << std::endl; } } while (0)
+
+#define CHECK_OUTPUT(value, expected) \
+	do { const std::string __actual = capture(value); if (__actual != (expected)) { ++failures; \
+		std::cerr << __FILE__ << ":" << __LINE__ << ": " << #value << " gives \"" << __actual << "\", expected \"" << (expected) << "\"" << std::endl; } } while (0)
+
+/*
+ * Keeps the last record. Records from a Logger that is not made by create()
+ * have no prefix, so the record is the message alone.
+ */
+class CaptureSink: public LogSink
+{
+public:
+	std::string record;
+
+	CaptureSink(Logger::LogLayout layout = Logger::LAYOUT_TEXT) :
+			LogSink(Logger::LOG_DEBUG, layout)
+	{
+	}
+
+	void write(Logger::LogLevel, const std::string &input)
+	{
+		record = input;
+	}
+};
+
+class NullSink: public LogSink
+{
+public:
+	void write(Logger::LogLevel, const std::string &)
+	{
+	}
+};
+
+/*
+ * Tells when it is destroyed
+ */
+class FlagSink: public NullSink
+{
+	bool &_destroyed;
+
+public:
+	FlagSink(bool &destroyed) :
+			_destroyed(destroyed)
+	{
+	}
+
+	~FlagSink()
+	{
+		_destroyed = true;
+	}
+};
+
+static CaptureSink* capture_sink = NULL;
+
+template<typename T>
+static std::string capture(const T& value)
+{
+	Logger(Logger::LOG_INFO) << value;
+	return capture_sink->record;
+}
+
+static long fileSize(const char* path)
+{
+	struct stat status;
+	return stat(path, &status) == 0 ? (long) status.st_size : -1;
+}
+
+static double now()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Deterministic values with negatives and fractions, saturated into the
+ * depth of the matrix
+ */
+static cv::Mat makeMat(int dims, const int* sizes, int depth, int channels)
+{
+	cv::Mat values(dims, sizes, CV_64FC(channels));
+	double* v = values.ptr<double>();
+	const size_t count = values.total() * channels;
+	for (size_t i = 0; i < count; ++i)
+		v[i] = ((int) (i * 37 % 101) - 30) * (depth >= CV_32F ? 0.125 : 1);
+
+	cv::Mat mat;
+	values.convertTo(mat, CV_MAKETYPE(depth, channels));
+	return mat;
+}
+
+static const char* const FormatNames[] = { "DEFAULT", "MATLAB", "CSV", "C", "OPENCV" };
+
+static void testScalars()
+{
+	CHECK_OUTPUT(42, "42");
+	CHECK_OUTPUT(-7L, "-7");
+	CHECK_OUTPUT(7UL, "7");
+	CHECK_OUTPUT((short) -3, "-3");
+	CHECK_OUTPUT((ushort) 3, "3");
+	CHECK_OUTPUT((uchar) 200, "200");
+	CHECK_OUTPUT((schar) -100, "-100");
+	CHECK_OUTPUT(2.5, "2.50000");
+	CHECK_OUTPUT(0.0, "0.00000");
+	CHECK_OUTPUT(-0.25f, "-0.25000");
+	CHECK_OUTPUT(true, "true");
+	CHECK_OUTPUT(false, "false");
+	CHECK_OUTPUT("text", "text");
+	CHECK_OUTPUT(std::string("text"), "text");
+}
+
+static void testContainers()
+{
+	std::vector<int> vector;
+	vector.push_back(1);
+	vector.push_back(2);
+	std::set<int> set(vector.begin(), vector.end());
+	std::deque<int> deque(vector.begin(), vector.end());
+	std::map<int, int> map;
+	map[1] = 2;
+
+	CHECK_OUTPUT(std::make_pair(1, 2), "1:2");
+	CHECK_OUTPUT(vector, "(2):1, 2, ");
+	CHECK_OUTPUT(set, "(2):1, 2, ");
+	CHECK_OUTPUT(deque, "(2):1,2,");
+	CHECK_OUTPUT(map, "[1:2, ]");
+}
+
+static void testOpenCVTypes()
+{
+	CHECK_OUTPUT(cv::Point(1, 2), "(1;2)");
+	CHECK_OUTPUT(cv::Size(3, 4), "w:3 x h:4");
+	CHECK_OUTPUT(cv::Rect(1, 2, 3, 4), "1,2:3x4");
+	CHECK_OUTPUT(cv::Range(1, 4), "1<->4 (3)");
+	CHECK_OUTPUT(cv::Scalar(1, 2, 3, 4), "1.00000,2.00000,3.00000,4.00000,");
+	CHECK_OUTPUT(cv::Point2f(1.5f, 2), "(1.50000;2.00000)");
+
+	cv::KeyPoint key_point;
+	key_point.pt = cv::Point2f(1, 2);
+	key_point.size = 3;
+	key_point.angle = 90;
+	key_point.response = 0.5f;
+	key_point.octave = 1;
+	key_point.class_id = -1;
+	CHECK_OUTPUT(key_point, "(1.00000;2.00000) size:3.00000 angle:90.00000 response:0.50000 octave:1");
+
+	cv::RotatedRect rect;
+	rect.center = cv::Point2f(1, 2);
+	rect.size = cv::Size2f(3, 4);
+	rect.angle = 45;
+	CHECK_OUTPUT(rect, "(1.00000;2.00000) w:3.00000 x h:4.00000 angle:45.00000");
+
+	cv::Matx<int, 2, 2> matx;
+	cv::Mat mat(2, 2, CV_32S);
+	for (int i = 0; i < 4; ++i)
+		matx(i / 2, i % 2) = mat.at<int>(i / 2, i % 2) = i * 10;
+	CHECK_OUTPUT(matx, capture(mat));
+
+	// every type has a name, also the depths this build does not know
+	for (int depth = 0; depth < CV_DEPTH_MAX; ++depth)
+		for (int channels = 1; channels <= 6; ++channels)
+		{
+			const int type = CV_MAKETYPE(depth, channels);
+			CHECK(Logger::getMatDepthFromCode(type) != NULL, "no name for type " << type);
+			CHECK(Logger::getMatPrimitiveFromCode(type) != NULL, "no primitive for type " << type);
+		}
+#ifdef CV_16BF
+	CHECK(strcmp(Logger::getMatDepthFromCode(CV_MAKETYPE(CV_64S, 2)), "CV_64SC2") == 0,
+			"CV_64SC2 is named " << Logger::getMatDepthFromCode(CV_MAKETYPE(CV_64S, 2)));
+#endif
+}
+
+struct Track
+{
+	int id;
+	cv::Point2f position;
+};
+
+template<>
+struct cvlog::formatter<Track>
+{
+	static void format(cvlog::Logger &log, const Track &track)
+	{
+		log << "#" << track.id << " at " << track.position;
+	}
+};
+
+/*
+ * A type with a cvlog::formatter is printed by it, also inside containers
+ * and format strings
+ */
+static void testFormatter()
+{
+	Track track = { 7, cv::Point2f(1, 2) };
+	CHECK_OUTPUT(track, "#7 at (1.00000;2.00000)");
+	CHECK_OUTPUT(std::vector<Track>(1, track), "(1):#7 at (1.00000;2.00000), ");
+
+	Logger(Logger::LOG_INFO).format<1>("track {}", track);
+	CHECK(capture_sink->record == "track #7 at (1.00000;2.00000)", "format string gives \"" << capture_sink->record << "\"");
+}
+
+/*
+ * Every depth and channel count (1-4, and 5 for the generic path) as a 2-D
+ * matrix, dims 1-4 for two types, cv::Mat_ and cv::Vec, each in every format
+ */
+static std::string renderMatrices()
+{
+	static const int Depths[] = { CV_8U, CV_8S, CV_16U, CV_16S, CV_32S, CV_32F, CV_64F, CV_16F };
+
+	std::stringstream out;
+	for (int f = 0; f < 5; ++f)
+	{
+		Logger::OutputFormat = (Logger::LogFormat) f;
+
+		for (size_t d = 0; d < sizeof(Depths) / sizeof(Depths[0]); ++d)
+		{
+			for (int c = 1; c <= 5; ++c)
+			{
+				const int sizes[] = { 3, 4 };
+				const cv::Mat mat = makeMat(2, sizes, Depths[d], c);
+				out << "### " << FormatNames[f] << " " << Logger::getMatDepthFromCode(mat.type()) << " 3x4\n"
+						<< capture(mat) << "\n";
+			}
+		}
+
+		static const int Types[] = { CV_8UC1, CV_32FC3 };
+		for (int t = 0; t < 2; ++t)
+		{
+			static const int Row[] = { 1, 5 }, Column[] = { 5, 1 }, Cube[] = { 2, 3, 4 }, Tesseract[] = { 2, 2, 2, 2 };
+			const cv::Mat mats[] = { makeMat(2, Row, CV_MAT_DEPTH(Types[t]), CV_MAT_CN(Types[t])), makeMat(2, Column,
+					CV_MAT_DEPTH(Types[t]), CV_MAT_CN(Types[t])), makeMat(3, Cube, CV_MAT_DEPTH(Types[t]),
+					CV_MAT_CN(Types[t])), makeMat(4, Tesseract, CV_MAT_DEPTH(Types[t]), CV_MAT_CN(Types[t])) };
+			static const char* const Names[] = { "1x5", "5x1", "2x3x4", "2x2x2x2" };
+
+			for (int m = 0; m < 4; ++m)
+				out << "### " << FormatNames[f] << " " << Logger::getMatDepthFromCode(Types[t]) << " " << Names[m]
+						<< "\n" << capture(mats[m]) << "\n";
+		}
+
+		const int sizes[] = { 3, 3 };
+		const cv::Mat_<float> mat_f = makeMat(2, sizes, CV_32F, 1);
+		const cv::Mat_<cv::Vec3b> mat_3b = makeMat(2, sizes, CV_8U, 3);
+		out << "### " << FormatNames[f] << " Mat_<float>\n" << capture(mat_f) << "\n";
+		out << "### " << FormatNames[f] << " Mat_<Vec3b>\n" << capture(mat_3b) << "\n";
+		out << "### " << FormatNames[f] << " Vec3f\n" << capture(cv::Vec3f(0.5f, -1.f, 2.f)) << "\n";
+		out << "### " << FormatNames[f] << " Vec<int,6>\n" << capture(cv::Vec<int, 6>(1, -2, 3, -4, 5, -6)) << "\n";
+	}
+	Logger::OutputFormat = Logger::FORMAT_DEFAULT;
+
+	return out.str();
+}
+
+static std::map<std::string, std::string> splitCases(const std::string &text)
+{
+	std::map<std::string, std::string> cases;
+	size_t start = 0;
+	while ((start = text.find("### ", start)) != std::string::npos)
+	{
+		const size_t name_end = text.find('\n', start);
+		size_t end = text.find("\n### ", name_end);
+		end = end == std::string::npos ? text.length() : end + 1;
+		cases[text.substr(start + 4, name_end - start - 4)] = text.substr(name_end + 1, end - name_end - 1);
+		start = end;
+	}
+	return cases;
+}
+
+static void testGoldenOutput(bool update)
+{
+	const std::string actual = renderMatrices();
+
+	if (update)
+	{
+		boost::filesystem::create_directories(boost::filesystem::path(LOGGER_GOLDEN_FILE).parent_path());
+		std::ofstream golden(LOGGER_GOLDEN_FILE);
+		golden << actual;
+		CHECK(golden.good(), "unable to write " << LOGGER_GOLDEN_FILE);
+		std::cout << "recorded " << LOGGER_GOLDEN_FILE << std::endl;
+		return;
+	}
+
+	std::ifstream in(LOGGER_GOLDEN_FILE);
+	if (!in.is_open())
+	{
+		CHECK(false, "no golden file " << LOGGER_GOLDEN_FILE << ", record it with \"logger_tests --update\"");
+		return;
+	}
+
+	std::stringstream expected;
+	expected << in.rdbuf();
+
+	const std::map<std::string, std::string> expected_cases = splitCases(expected.str());
+	const std::map<std::string, std::string> actual_cases = splitCases(actual);
+	for (std::map<std::string, std::string>::const_iterator c = actual_cases.begin(); c != actual_cases.end(); ++c)
+	{
+		std::map<std::string, std::string>::const_iterator e = expected_cases.find(c->first);
+		if (e == expected_cases.end())
+			CHECK(false, "no golden output for " << c->first);
+		else
+			CHECK(e->second == c->second,
+					c->first << " gives:\n" << c->second << "expected:\n" << e->second);
+	}
+	CHECK(expected_cases.size() == actual_cases.size(), "golden file has cases that are no longer rendered");
+}
+
+/*
+ * A matrix logged again with the same type and shape keeps the widest
+ * column widths seen so far
+ */
+static void testStableLayout()
+{
+	cv::Mat narrow(1, 2, CV_8UC1, cv::Scalar(2));
+	cv::Mat wide = narrow.clone();
+	narrow.at<uchar>(0, 0) = 1;
+	wide.at<uchar>(0, 0) = 100;
+
+	const std::string measured = capture(narrow);
+	Logger::StableLayout = true;
+	const std::string first = capture(narrow);
+	const std::string widened = capture(wide);
+	const std::string kept = capture(narrow);
+	Logger::StableLayout = false;
+
+	CHECK(first == measured, "first stable layout differs from the measured one");
+	CHECK(kept != measured && kept.length() == widened.length(), "stable layout did not keep the widened column");
+}
+
+/*
+ * Former configs do not keep removed sinks alive, also after other settings
+ * changed in between
+ */
+static void testSinkRemoval()
+{
+	bool destroyed = false;
+	{
+		cv::Ptr<LogSink> sink(new FlagSink(destroyed));
+		Logger::addSink(sink);
+		Logger(Logger::LOG_INFO) << "to the sink";
+		Logger::Precision = 3;
+		Logger::Precision = 5;
+		Logger::removeSink(sink);
+		CHECK(!destroyed, "sink destroyed while the caller holds it");
+	}
+	CHECK(destroyed, "removed sink is still held by a former config");
+}
+
+/*
+ * Changes within the tolerance are held back until they add up, NaN counts
+ * as a value of its own, and a new shape or type is logged in full
+ */
+static void testDelta()
+{
+	Logger::clearDeltas();
+	cv::Mat m(1, 3, CV_64F, cv::Scalar(1));
+	const std::string full = capture(m);
+	CHECK_OUTPUT(Logger::delta(m, 1, "m"), full);
+
+	m.at<double>(0, 0) = 1.5;
+	m.at<double>(0, 1) = 1.0000001;
+	CHECK_OUTPUT(Logger::delta(m, 1, "m"), "CV_64F(1x3) unchanged");
+
+	m.at<double>(0, 0) = 2.5;
+	m.at<double>(0, 2) = std::numeric_limits<double>::quiet_NaN();
+	CHECK_OUTPUT(Logger::delta(m, 1, "m"), "CV_64F(1x3) 2/3 changed: (0,0): 1.00000 -> 2.50000 (0,2): 1.00000 -> nan");
+	CHECK_OUTPUT(Logger::delta(m, 1, "m"), "CV_64F(1x3) unchanged");
+
+	m.at<double>(0, 2) = 1;
+	CHECK_OUTPUT(Logger::delta(m, 1, "m"), "CV_64F(1x3) 1/3 changed: (0,2): nan -> 1.00000");
+
+	const cv::Mat column = m.reshape(1, 3);
+	CHECK_OUTPUT(Logger::delta(column, 1, "m"), capture(column));
+
+	cv::Mat floats;
+	column.convertTo(floats, CV_32F);
+	CHECK_OUTPUT(Logger::delta(floats, 1, "m"), capture(floats));
+
+	// untagged deltas of one statement are tracked apart
+	cv::Mat a(1, 1, CV_64F, cv::Scalar(1)), b(1, 1, CV_64F, cv::Scalar(1));
+	for (int i = 0; i < 2; ++i)
+	{
+		b.at<double>(0, 0) = i;
+		Logger(Logger::LOG_INFO) << Logger::delta(a) << " " << Logger::delta(b);
+	}
+	CHECK(capture_sink->record == "CV_64F(1x1) unchanged CV_64F(1x1) 1/1 changed: (0,0): 0.00000 -> 1.00000",
+			"two deltas in one record give \"" << capture_sink->record << "\"");
+}
+
+/*
+ * Frames arrive whole and in order at a listening socket, as they would at
+ * tools/LogCollector
+ */
+static void testSocketSink()
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/logger_tests_%d.sock", (int) getpid());
+	unlink(path);
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	CHECK(listener >= 0 && bind(listener, (const sockaddr*) &address, sizeof(address)) == 0 && listen(listener, 1) == 0,
+			"unable to listen on " << path);
+
+	{
+		SocketSink sink(path);
+		sink.write(Logger::LOG_WARN, "first");
+		sink.write(Logger::LOG_INFO, "second");
+	}
+
+	std::string received;
+	int client = accept(listener, NULL, NULL);
+	char buffer[256];
+	ssize_t length;
+	while (client >= 0 && (length = read(client, buffer, sizeof(buffer))) > 0)
+		received.append(buffer, length);
+
+	const std::string expected = std::string("\0\0\0\6", 4) + (char) Logger::LOG_WARN + "first"
+			+ std::string("\0\0\0\7", 4) + (char) Logger::LOG_INFO + "second";
+	CHECK(received == expected, "socket sink sent " << received.length() << " bytes, expected " << expected.length());
+
+	if (client >= 0) close(client);
+	close(listener);
+	unlink(path);
+}
+
+/*
+ * A collector that drops every connection is reached at most once per
+ * reconnect interval (250 ms), however many records are written meanwhile
+ */
+static void testSocketSinkReconnect()
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/logger_tests_%d.sock", (int) getpid());
+	unlink(path);
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	CHECK(listener >= 0 && bind(listener, (const sockaddr*) &address, sizeof(address)) == 0 && listen(listener, 8) == 0,
+			"unable to listen on " << path);
+	fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+
+	int connections = 0;
+	{
+		SocketSink sink(path);
+		for (int i = 0; i < 200; ++i)
+		{
+			sink.write(Logger::LOG_INFO, "record");
+			usleep(2000);
+
+			int client;
+			while ((client = accept(listener, NULL, NULL)) >= 0)
+			{
+				close(client);
+				++connections;
+			}
+		}
+	}
+	CHECK(connections >= 1 && connections <= 4, "socket sink connected " << connections << " times in 400 ms");
+
+	close(listener);
+	unlink(path);
+}
+
+/*
+ * Records reach the file after the number of records of the policy, or
+ * right away at WARN
+ */
+static void testFileSinkFlush()
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/logger_tests_%d.txt", (int) getpid());
+	unlink(path);
+
+	FileSink sink(path, FileSink::FlushPolicy(3, 0, true));
+	sink.write(Logger::LOG_INFO, "one");
+	sink.write(Logger::LOG_INFO, "two");
+	CHECK(fileSize(path) == 0, "file sink flushed before the third record");
+	sink.write(Logger::LOG_INFO, "three");
+	CHECK(fileSize(path) == 14, "file sink did not flush after the third record");
+	sink.write(Logger::LOG_WARN, "four");
+	CHECK(fileSize(path) == 19, "file sink did not flush a warning");
+
+	unlink(path);
+}
+
+/*
+ * Every flush, and the exit, brings the index up to date with the records in
+ * the file
+ */
+static void testFileSinkIndex()
+{
+	char path[64], index_path[80];
+	snprintf(path, sizeof(path), "/tmp/logger_tests_%d.txt", (int) getpid());
+	snprintf(index_path, sizeof(index_path), "%s.idx", path);
+	unlink(path);
+	unlink(index_path);
+
+	FileSink sink(path);
+	CHECK(sink.setIndex(1000), "unable to index " << path);
+	CHECK(fileSize(index_path) == 16, "index header is " << fileSize(index_path) << " bytes, expected 16");
+
+	const std::string file = "tracker.cpp";
+	const LogSink::Origin origin = { timeval(), file, 12 };
+	sink.write(Logger::LOG_INFO, "one", origin);
+	sink.write(Logger::LOG_INFO, "two", origin);
+	sink.flush();
+
+	// header, one block: bucket, level, line, name, count, first, size and two (gap, length) pairs
+	const long expected = 16 + 8 + 1 + 4 + 2 + (long) file.length() + 4 + 8 + 4 + 4;
+	CHECK(fileSize(index_path) == expected, "index is " << fileSize(index_path) << " bytes, expected " << expected);
+	unlink(path);
+	unlink(index_path);
+
+	// a registered sink is never destroyed, its last records are indexed at exit
+	const pid_t child = fork();
+	if (child == 0)
+	{
+		FileSink* registered = new FileSink(path);
+		registered->setIndex(1000);
+		Logger::addSink(cv::Ptr<LogSink>(registered));
+		CVLog(INFO) << "last";
+		exit(EXIT_SUCCESS);
+	}
+	int status = -1;
+	waitpid(child, &status, 0);
+	CHECK(status == 0 && fileSize(index_path) > 16, "index at exit is " << fileSize(index_path) << " bytes");
+
+	unlink(path);
+	unlink(index_path);
+}
+
+/*
+ * An image is only scaled and queued for a record that is written, and one
+ * that cannot get its directory is dropped; a changed directory is created
+ */
+static void testImages()
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/logger_tests_%d.txt", (int) getpid());
+	std::ofstream(path).close();
+
+	// the directory cannot be created under a file
+	ImageWriter::configure(std::string(path) + "/images");
+	const cv::Mat frame(4, 4, CV_8UC1, cv::Scalar(128));
+	const size_t dropped = ImageWriter::getDropped();
+
+	Logger::create(Logger::LOG_INFO, "", 0, Logger::SITE_DISABLED) << Logger::image(frame);
+	CHECK(ImageWriter::getDropped() == dropped, "image of a record that is not written queued");
+
+	Logger(Logger::LOG_INFO) << Logger::image(frame);
+	CHECK(capture_sink->record == "CV_8U(4x4) mean(128.00000) image dropped",
+			"image without its directory gives \"" << capture_sink->record << "\"");
+	CHECK(ImageWriter::getDropped() == dropped + 1, "image without its directory not counted as dropped");
+	unlink(path);
+
+	// each directory is created with its first image
+	char directory[64];
+	snprintf(directory, sizeof(directory), "/tmp/logger_tests_%d_images", (int) getpid());
+	ImageWriter::configure(directory);
+	const std::string first = ImageWriter::write(frame);
+	ImageWriter::configure(std::string(directory) + "/later");
+	const std::string later = ImageWriter::write(frame);
+	ImageWriter::flush();
+	CHECK(boost::filesystem::exists(first), "image not written to " << first);
+	CHECK(boost::filesystem::exists(later), "image not written to a directory configured later: " << later);
+
+	boost::filesystem::remove_all(directory);
+}
+
+static int evaluations = 0;
+
+static int evaluate()
+{
+	return ++evaluations;
+}
+
+static void logLevel()
+{
+	CVLog(INFO) << "level " << evaluate();
+}
+
+/*
+ * A call site switched off by a glob on the base name of this file neither
+ * evaluates its insertions nor reports itself enabled, and a record taken
+ * over from CVLog is written once. Level switches call sites off alike.
+ */
+static void testModuleLevels()
+{
+	evaluations = 0;
+	Logger::setLevel("LoggerTests*", "OFF");
+	CVLog(ERROR) << "off " << evaluate();
+	CHECK(evaluations == 0, "insertions evaluated at a disabled call site");
+	{
+		Logger logger = CVLog(ERROR);
+		CHECK(!logger.isEnabled(), "a disabled call site is enabled");
+	}
+	Logger::clearLevels();
+
+	CVLog(INFO) << "on " << evaluate();
+	CHECK(evaluations == 1, "insertions at an enabled call site evaluated " << evaluations << " times");
+
+	capture_sink->record.clear();
+	{
+		Logger logger = CVLog(INFO);
+		logger << "taken over";
+		CHECK(capture_sink->record.empty(), "record written before the logger that took it over");
+	}
+	CHECK(capture_sink->record.find("taken over") != std::string::npos,
+			"record taken over from CVLog gives \"" << capture_sink->record << "\"");
+
+	// Level disables a call site as well, without allocating, until it changes
+	const std::shared_ptr<const Logger::SinkList> sinks = Logger::getSinks();
+	Logger::clearSinks();
+	Logger::Level = Logger::LOG_WARN;
+	evaluations = 0;
+	logLevel();
+	const size_t before = allocations.load();
+	logLevel();
+	const size_t allocated = allocations.load() - before;
+	CHECK(evaluations == 0, "insertions evaluated at a call site below Level");
+	CHECK(allocated == 0, allocated << " allocations at a call site below Level");
+
+	Logger::Level = Logger::LOG_DEBUG;
+	for (Logger::SinkList::const_iterator sink = sinks->begin(); sink != sinks->end(); ++sink)
+		Logger::addSink(*sink);
+	logLevel();
+	CHECK(evaluations == 1, "call site not enabled again when Level changed");
+}
+
+/*
+ * The context of the thread is in the prefix of text records and in the
+ * members of JSON records, and disappears with its scope
+ */
+static void testLogContext()
+{
+	CaptureSink* json = new CaptureSink(Logger::LAYOUT_JSON);
+	cv::Ptr<LogSink> json_sink(json);
+	Logger::addSink(json_sink);
+
+	LogContext::setThreadName("tests");
+	{
+		LogContext camera("camera", 2);
+		LogContext frame("frame", 17);
+		CVLog(INFO) << "grabbed";
+	}
+	CHECK(capture_sink->record.find("INFO  [tests camera=2 frame=17]\tgrabbed") != std::string::npos,
+			"context missing from \"" << capture_sink->record << "\"");
+	CHECK(json->record.find(",\"thread_name\":\"tests\",\"ctx\":{\"camera\":2,\"frame\":17}") != std::string::npos,
+			"context missing from " << json->record);
+
+	CVLog(INFO) << "released";
+	CHECK(capture_sink->record.find("INFO  [tests]\treleased") != std::string::npos,
+			"context not released in \"" << capture_sink->record << "\"");
+
+	LogContext::setThreadName("");
+	Logger::removeSink(json_sink);
+}
+
+/*
+ * Matrices logged by reference are printed by the backend as they would have
+ * been inline, and a snapshot does not see later writes to the matrix
+ */
+static void testAsyncMatRef()
+{
+	cv::Mat matrix(2, 2, CV_32S, cv::Scalar(1));
+	matrix.at<int>(1, 1) = 4;
+	const std::string before = capture(matrix);
+	Logger(Logger::LOG_INFO) << "m=" << cv::Mat(2, 2, CV_32S, cv::Scalar(9)) << " done";
+	const std::string after = capture_sink->record;
+
+	Logger::AsyncQueue = 4;
+
+	Logger(Logger::LOG_INFO) << Logger::ref(matrix, true);
+	matrix.setTo(9);
+	Logger::flushQueue();
+	CHECK(capture_sink->record == before, "snapshot gives \"" << capture_sink->record << "\", expected \"" << before << "\"");
+
+	Logger(Logger::LOG_INFO) << "m=" << Logger::ref(matrix) << " done";
+	Logger::flushQueue();
+	CHECK(capture_sink->record == after, "reference gives \"" << capture_sink->record << "\", expected \"" << after << "\"");
+
+	Logger::AsyncQueue = 0;
+}
+
+/*
+ * Holds the backend in write() until it is opened
+ */
+class GateSink: public LogSink
+{
+public:
+	std::atomic<bool> open;
+
+	GateSink() :
+			open(true)
+	{
+	}
+
+	void write(Logger::LogLevel, const std::string &)
+	{
+		while (!open.load())
+			usleep(1000);
+	}
+};
+
+/*
+ * A trace event queued for the backend keeps the name of its scope after
+ * the name has gone
+ */
+static void testAsyncScopeName()
+{
+	CaptureSink* trace = new CaptureSink(Logger::LAYOUT_TRACE);
+	cv::Ptr<LogSink> trace_sink(trace);
+	GateSink* gate = new GateSink();
+	cv::Ptr<LogSink> gate_sink(gate);
+	Logger::addSink(trace_sink);
+	Logger::addSink(gate_sink);
+	Logger::Tracing = true;
+	Logger::AsyncQueue = 4;
+
+	gate->open = false;
+	Logger(Logger::LOG_INFO) << "holds the backend";
+	{
+		std::string name = "stage";
+		LogScope scope(name.c_str());
+		scope.stop();
+		name.assign("gone!");
+	}
+	gate->open = true;
+	Logger::flushQueue();
+	CHECK(trace->record.find("{\"name\":\"stage\",") == 0, "queued trace event gives " << trace->record);
+
+	Logger::AsyncQueue = 0;
+	Logger::Tracing = false;
+	Logger::removeSink(gate_sink);
+	Logger::removeSink(trace_sink);
+}
+
+/*
+ * Keeps every record, slowly
+ */
+class SlowSink: public LogSink
+{
+public:
+	std::vector<std::string> records;
+
+	void write(Logger::LogLevel, const std::string &input)
+	{
+		usleep(1000);
+		records.push_back(input);
+	}
+};
+
+/*
+ * A queue that the sink cannot keep up with sheds DEBUG and INFO records but
+ * keeps every ERROR, and the summaries account for exactly the records that
+ * were not written
+ */
+static void testBackpressure()
+{
+	static const int Records = 50;
+
+	SlowSink* slow = new SlowSink();
+	cv::Ptr<LogSink> slow_sink(slow);
+	Logger::addSink(slow_sink);
+
+	const unsigned long debug_before = Logger::getDropped(Logger::LOG_DEBUG);
+	const unsigned long info_before = Logger::getDropped(Logger::LOG_INFO);
+	Logger::AsyncQueue = 8;
+
+	for (int i = 0; i < Records; ++i)
+	{
+		Logger(Logger::LOG_DEBUG) << "debug";
+		Logger(Logger::LOG_INFO) << "info";
+		Logger(Logger::LOG_ERROR) << "error";
+	}
+	Logger::flushQueue();
+	Logger::AsyncQueue = 0;
+	Logger::removeSink(slow_sink);
+
+	const unsigned long debug_dropped = Logger::getDropped(Logger::LOG_DEBUG) - debug_before;
+	const unsigned long info_dropped = Logger::getDropped(Logger::LOG_INFO) - info_before;
+
+	int debug = 0, info = 0, error = 0;
+	unsigned long debug_reported = 0, info_reported = 0;
+	for (size_t i = 0; i < slow->records.size(); ++i)
+	{
+		const std::string &record = slow->records[i];
+		const size_t fields = record.find(" dropped_debug=");
+		unsigned long d, n;
+		if (fields != std::string::npos && sscanf(record.c_str() + fields, " dropped_debug=%lu dropped_info=%lu", &d, &n) == 2)
+		{
+			debug_reported += d;
+			info_reported += n;
+		}
+		debug += record == "debug";
+		info += record == "info";
+		error += record == "error";
+	}
+
+	CHECK(error == Records, error << " of " << Records << " errors written");
+	CHECK(debug_dropped > 0, "no debug records dropped from a queue the sink cannot keep up with");
+	CHECK(debug + debug_dropped == Records && info + info_dropped == Records,
+			debug << " debug and " << info << " info records written, " << debug_dropped << " and " << info_dropped << " dropped");
+	CHECK(debug_reported == debug_dropped && info_reported == info_dropped,
+			debug_reported << " and " << info_reported << " dropped records reported, " << debug_dropped << " and " << info_dropped << " dropped");
+}
+
+/*
+ * Keeps every record, for sinks written to from other threads
+ */
+class ListSink: public LogSink
+{
+	std::mutex _mutex;
+	std::vector<std::string> _records;
+
+public:
+	void write(Logger::LogLevel, const std::string &input)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_records.push_back(input);
+	}
+
+	size_t count(const std::string &text)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		size_t found = 0;
+		for (size_t i = 0; i < _records.size(); ++i)
+			found += _records[i].find(text) != std::string::npos;
+		return found;
+	}
+
+	/*
+	 * Waits up to two seconds for a record with the text
+	 */
+	bool await(const std::string &text)
+	{
+		for (int i = 0; i < 200 && count(text) == 0; ++i)
+			usleep(10 * 1000);
+		return count(text) > 0;
+	}
+};
+
+static void repeat(int times)
+{
+	for (int i = 0; i < times; ++i)
+		CVLog(WARN) << "no features found";
+}
+
+/*
+ * Repeats are reported once their window has passed, also without another
+ * record, and when their thread exits before that
+ */
+static void testCoalesce()
+{
+	ListSink* list = new ListSink();
+	cv::Ptr<LogSink> list_sink(list);
+	Logger::addSink(list_sink);
+
+	Logger::CoalesceWindow = 50;
+	repeat(3);
+	CHECK(list->count("no features found") == 1, list->count("no features found") << " records written of 3 repeats");
+	CHECK(list->await("no features found (repeated 2 times, "), "repeats not reported when the window passed");
+
+	Logger::CoalesceWindow = 60 * 1000;
+	std::thread thread(repeat, 4);
+	thread.join();
+	CHECK(list->await("no features found (repeated 3 times, "), "repeats not reported when their thread exited");
+
+	Logger::CoalesceWindow = 0;
+	Logger::removeSink(list_sink);
+}
+
+static double lineCost(int tokens, int iterations)
+{
+	double start = now();
+	for (int i = 0; i < iterations; ++i)
+	{
+		Logger logger(Logger::LOG_INFO);
+		for (int t = 0; t < tokens; t += 2)
+			logger << "a" << i;
+	}
+	return (now() - start) / iterations;
+}
+
+static void testAllocations()
+{
+	// measured on a release build: exactly 2 allocations per line
+	static const size_t MaxAllocationsPerLine = 2;
+
+	Logger::clearSinks();
+	Logger::addSink(cv::Ptr<LogSink>(new NullSink()));
+
+	const int iterations = 100000;
+	lineCost(2, iterations / 10);
+
+	const size_t before = allocations.load();
+	for (int i = 0; i < iterations; ++i)
+		Logger(Logger::LOG_INFO) << "x=" << i << " y=" << 2.5 << " ok=" << true;
+	const double per_line = (allocations.load() - before) / (double) iterations;
+	CHECK(per_line <= MaxAllocationsPerLine, per_line << " allocations per line, at most " << MaxAllocationsPerLine);
+
+	std::cout << "allocations per line: " << per_line << std::endl;
+}
+
+/*
+ * Depends on the machine, so only run with --performance (ctest -C Performance)
+ */
+static void testPerformance()
+{
+	// measured on a release build: 28-48 ns per token on an idle core and
+	// about 90 ns with a second busy process
+	const char* limit = getenv("LOGGER_TESTS_MAX_NS_PER_TOKEN");
+	const double max_ns_per_token = limit != NULL ? atof(limit) : 200;
+
+	Logger::clearSinks();
+	Logger::addSink(cv::Ptr<LogSink>(new NullSink()));
+
+	const int iterations = 100000;
+	lineCost(2, iterations / 10);
+
+	const double short_line = lineCost(2, iterations);
+	const double long_line = lineCost(34, iterations);
+	const double per_token = (long_line - short_line) / 32;
+	CHECK(per_token <= max_ns_per_token, per_token << " ns per scalar token, at most " << max_ns_per_token);
+
+	std::cout << "ns per token: " << per_token << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	const bool update = argc > 1 && strcmp(argv[1], "--update") == 0;
+
+	if (argc > 1 && strcmp(argv[1], "--performance") == 0)
+	{
+		testPerformance();
+		return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	capture_sink = new CaptureSink();
+	Logger::addSink(cv::Ptr<LogSink>(capture_sink));
+
+	testScalars();
+	testContainers();
+	testOpenCVTypes();
+	testFormatter();
+	testGoldenOutput(update);
+	testStableLayout();
+	testDelta();
+	testSinkRemoval();
+	testSocketSink();
+	testSocketSinkReconnect();
+	testFileSinkFlush();
+	testFileSinkIndex();
+	testImages();
+	testModuleLevels();
+	testLogContext();
+	testAsyncMatRef();
+	testAsyncScopeName();
+	testBackpressure();
+	testCoalesce();
+	testAllocations();
+
+	if (failures > 0) std::cerr << failures << " failure(s)" << std::endl;
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,155 @@
+/*
+ * LogCollector.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *
+ * Reference collector for SocketSink: listens on a Unix socket and writes
+ * every record it receives, followed by a newline, to a file or stdout.
+ *
+ * log_collector [-t stream|seqpacket|dgram] <socket path> [output file]
+ *
+ * A frame is a 4-byte big-endian length, followed by that many bytes: the
+ * level (one byte) and the record. Frames cut off by a client that
+ * disconnects are discarded.
+ */
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static volatile sig_atomic_t stopped = 0;
+
+static void stop(int)
+{
+	stopped = 1;
+}
+
+/*
+ * Writes the complete frames at the start of the data and removes them
+ */
+static void writeFrames(std::string &data, FILE* out)
+{
+	size_t start = 0;
+	while (data.length() - start >= 4)
+	{
+		const unsigned char* header = (const unsigned char*) data.data() + start;
+		const size_t length = ((size_t) header[0] << 24) | ((size_t) header[1] << 16) | ((size_t) header[2] << 8)
+				| header[3];
+		if (data.length() - start - 4 < length) break;
+
+		// skip the level byte
+		if (length > 1) fwrite(data.data() + start + 5, 1, length - 1, out);
+		fputc('\n', out);
+		start += 4 + length;
+	}
+	data.erase(0, start);
+}
+
+int main(int argc, char** argv)
+{
+	int type = SOCK_STREAM;
+	int arg = 1;
+	if (argc > 2 && strcmp(argv[1], "-t") == 0)
+	{
+		const std::string name = argv[2];
+		type = name == "dgram" ? SOCK_DGRAM : name == "seqpacket" ? SOCK_SEQPACKET : SOCK_STREAM;
+		arg = 3;
+	}
+	if (arg >= argc)
+	{
+		fprintf(stderr, "usage: %s [-t stream|seqpacket|dgram] <socket path> [output file]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const char* path = argv[arg];
+	FILE* out = arg + 1 < argc ? fopen(argv[arg + 1], "a") : stdout;
+	if (out == NULL)
+	{
+		perror(argv[arg + 1]);
+		return EXIT_FAILURE;
+	}
+
+	int listener = socket(AF_UNIX, type, 0);
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+	unlink(path);
+
+	if (listener < 0 || bind(listener, (const sockaddr*) &address, sizeof(address)) != 0
+			|| (type != SOCK_DGRAM && listen(listener, 16) != 0))
+	{
+		perror(path);
+		return EXIT_FAILURE;
+	}
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	signal(SIGPIPE, SIG_IGN);
+
+	// the listener first, then one entry per connected client
+	std::vector<pollfd> fds(1);
+	std::vector<std::string> pending(1);
+	fds[0].fd = listener;
+	fds[0].events = POLLIN;
+
+	std::vector<char> buffer(1 << 16);
+	while (!stopped)
+	{
+		if (poll(&fds[0], fds.size(), 500) < 0)
+		{
+			if (errno == EINTR) continue;
+			perror("poll");
+			break;
+		}
+
+		for (size_t i = 0; i < fds.size(); ++i)
+		{
+			if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+			if (i == 0 && type != SOCK_DGRAM)
+			{
+				int client = accept(listener, NULL, NULL);
+				if (client < 0) continue;
+
+				pollfd entry = { client, POLLIN, 0 };
+				fds.push_back(entry);
+				pending.push_back(std::string());
+				continue;
+			}
+
+			const ssize_t received = recv(fds[i].fd, &buffer[0], buffer.size(), 0);
+			if (received > 0)
+			{
+				pending[i].append(&buffer[0], received);
+				writeFrames(pending[i], out);
+
+				// a datagram holds whole frames only
+				if (type != SOCK_STREAM) pending[i].clear();
+			}
+			else if (i > 0 && (received == 0 || errno != EINTR))
+			{
+				close(fds[i].fd);
+				fds.erase(fds.begin() + i);
+				pending.erase(pending.begin() + i);
+				--i;
+			}
+		}
+		fflush(out);
+	}
+
+	for (size_t i = 0; i < fds.size(); ++i)
+		close(fds[i].fd);
+	unlink(path);
+	if (out != stdout) fclose(out);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,469 @@
+/*
+ * LogQuery.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *
+ * Finds records in a log-file through the index a FileSink writes next to
+ * it (FileSink::setIndex), reading only the records that match:
+ *
+ * log_query [-f from] [-t to] [-l level] [-s site] [-o text|json] [-c] <log file>
+ *
+ * -f, -t  time range, as seconds since the epoch or "YYYY-MM-DD HH:MM:SS"
+ * -l      least important level (DEBUG < INFO < WARN < ERROR)
+ * -s      glob on the call site, "file:line"
+ * -o      renders text records as JSON or JSON records as text, records
+ *         are written as they are otherwise
+ * -c      counts the matching records per level and call site from the
+ *         index alone
+ *
+ * Records written after the index was last flushed, with the log-file or at
+ * exit, are not searched.
+ */
+#include <fnmatch.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+// values of Logger::LogLevel
+static const char* const LevelNames[] = { "INFO", "DEBUG", "WARN", "ERROR" };
+static const int Severities[] = { 1, 0, 2, 3 };
+
+struct Block
+{
+	int64_t bucket; // us since the epoch
+	int level;
+	int line;
+	std::string file;
+	uint32_t count;
+	uint64_t first;
+	std::string records;
+};
+
+struct Record
+{
+	uint64_t offset;
+	uint64_t length;
+	const Block* block;
+
+	bool operator<(const Record &other) const
+	{
+		return offset < other.offset;
+	}
+};
+
+template<typename T>
+static bool readLittleEndian(FILE* in, T &value)
+{
+	uint64_t v = 0;
+	for (size_t i = 0; i < sizeof(T); ++i)
+	{
+		const int c = fgetc(in);
+		if (c == EOF) return false;
+		v |= (uint64_t) c << (8 * i);
+	}
+	value = (T) v;
+	return true;
+}
+
+static bool readBytes(FILE* in, std::string &out, size_t length)
+{
+	out.resize(length);
+	return length == 0 || fread(&out[0], 1, length, in) == length;
+}
+
+/*
+ * Block as FileSink::writeIndex writes it
+ */
+static bool readBlock(FILE* in, Block &block)
+{
+	uint8_t level;
+	uint32_t line, size;
+	uint16_t name;
+	if (!readLittleEndian(in, block.bucket) || !readLittleEndian(in, level) || !readLittleEndian(in, line)
+			|| !readLittleEndian(in, name) || !readBytes(in, block.file, name) || !readLittleEndian(in, block.count)
+			|| !readLittleEndian(in, block.first) || !readLittleEndian(in, size) || !readBytes(in, block.records, size))
+	{
+		return false;
+	}
+
+	block.level = level;
+	block.line = line;
+	return level < 4;
+}
+
+static uint64_t readVarint(const std::string &data, size_t &position)
+{
+	uint64_t value = 0;
+	for (int shift = 0; position < data.length(); shift += 7)
+	{
+		const unsigned char c = data[position++];
+		value |= (uint64_t) (c & 0x7f) << shift;
+		if (!(c & 0x80)) break;
+	}
+	return value;
+}
+
+static void getRecords(const Block &block, std::vector<Record> &records)
+{
+	size_t position = 0;
+	uint64_t end = block.first;
+	for (uint32_t r = 0; r < block.count; ++r)
+	{
+		Record record;
+		record.offset = end + readVarint(block.records, position);
+		record.length = readVarint(block.records, position);
+		record.block = &block;
+		records.push_back(record);
+		end = record.offset + record.length;
+	}
+}
+
+/*
+ * Seconds since the epoch, or local "YYYY-MM-DD HH:MM:SS"
+ */
+static bool parseTime(const char* text, double &seconds)
+{
+	tm t;
+	memset(&t, 0, sizeof(t));
+	const char* end = strptime(text, "%Y-%m-%d %H:%M:%S", &t);
+	if (end == NULL) end = strptime(text, "%Y-%m-%dT%H:%M:%S", &t);
+	if (end != NULL && *end == '\0')
+	{
+		t.tm_isdst = -1;
+		seconds = mktime(&t);
+		return true;
+	}
+
+	char* number_end;
+	seconds = strtod(text, &number_end);
+	return *text != '\0' && *number_end == '\0';
+}
+
+static int getLevel(const char* name)
+{
+	for (int i = 0; i < 4; ++i)
+		if (strcasecmp(name, LevelNames[i]) == 0) return i;
+	return -1;
+}
+
+/*
+ * Time of a text record, its "HH:MM:SS.mmm" prefix on the local date of
+ * the bucket it is in
+ */
+static bool getTextTime(const std::string &record, int64_t bucket, double &seconds)
+{
+	int hours, minutes, secs, millis;
+	if (sscanf(record.c_str(), "%2d:%2d:%2d.%3d", &hours, &minutes, &secs, &millis) != 4) return false;
+
+	time_t bucket_time = bucket / 1000000;
+	tm t;
+	localtime_r(&bucket_time, &t);
+	t.tm_hour = hours;
+	t.tm_min = minutes;
+	t.tm_sec = secs;
+	t.tm_isdst = -1;
+	seconds = mktime(&t) + millis / 1000.0;
+
+	// written just after midnight in a bucket that started before it
+	if (seconds < bucket / 1e6 - 43200) seconds += 86400;
+	return true;
+}
+
+static void appendJsonString(std::string &out, const char* text, size_t length)
+{
+	out += '"';
+	for (size_t i = 0; i < length; ++i)
+	{
+		const unsigned char c = text[i];
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if (c == '\n')
+			out += "\\n";
+		else if (c == '\t')
+			out += "\\t";
+		else if (c < 0x20)
+		{
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			out += escaped;
+		}
+		else
+			out += c;
+	}
+	out += '"';
+}
+
+/*
+ * {"ts":..,"level":..,"file":..,"line":..,"msg":..} from a text record
+ */
+static std::string textToJson(const std::string &record, const Block &block)
+{
+	double seconds;
+	if (!getTextTime(record, block.bucket, seconds)) seconds = block.bucket / 1e6;
+
+	const size_t tab = record.find('\t');
+	const size_t message = tab == std::string::npos ? 0 : tab + 1;
+
+	char ts[32];
+	snprintf(ts, sizeof(ts), "%.6f", seconds);
+	std::string out = std::string("{\"ts\":") + ts + ",\"level\":\"" + LevelNames[block.level] + "\"";
+	if (block.line > 0)
+	{
+		out += ",\"file\":";
+		appendJsonString(out, block.file.data(), block.file.length());
+		out += ",\"line\":" + std::to_string(block.line);
+	}
+	out += ",\"msg\":";
+	appendJsonString(out, record.data() + message, record.length() - message);
+	return out + "}";
+}
+
+/*
+ * End of the JSON value that starts at position
+ */
+static size_t skipJsonValue(const std::string &json, size_t position)
+{
+	int depth = 0;
+	bool quoted = false;
+	for (; position < json.length(); ++position)
+	{
+		const char c = json[position];
+		if (quoted)
+		{
+			if (c == '\\')
+				++position;
+			else if (c == '"') quoted = false;
+			if (!quoted && depth == 0) return position + 1;
+		}
+		else if (c == '"')
+			quoted = true;
+		else if (c == '{' || c == '[')
+			++depth;
+		else if (c == '}' || c == ']')
+		{
+			if (depth == 0) return position;
+			if (--depth == 0) return position + 1;
+		}
+		else if (c == ',' && depth == 0) return position;
+	}
+	return position;
+}
+
+static std::string unescapeJsonString(const std::string &value)
+{
+	std::string out;
+	for (size_t i = 1; i + 1 < value.length(); ++i)
+	{
+		if (value[i] != '\\' || i + 2 >= value.length())
+		{
+			out += value[i];
+			continue;
+		}
+
+		const char c = value[++i];
+		if (c == 'n')
+			out += '\n';
+		else if (c == 't')
+			out += '\t';
+		else if (c == 'u' && i + 4 < value.length())
+		{
+			out += (char) strtol(value.substr(i + 1, 4).c_str(), NULL, 16);
+			i += 4;
+		}
+		else
+			out += c;
+	}
+	return out;
+}
+
+/*
+ * "HH:MM:SS.mmm file:line LEVEL\tmsg key=value.." from a JSON record
+ */
+static std::string jsonToText(const std::string &record, const Block &block)
+{
+	double seconds = block.bucket / 1e6;
+	std::string message, fields;
+
+	size_t position = record.find('{');
+	while (position != std::string::npos && position + 1 < record.length())
+	{
+		const size_t key_start = record.find('"', position + 1);
+		if (key_start == std::string::npos) break;
+		const size_t key_end = skipJsonValue(record, key_start);
+		const size_t value_start = record.find(':', key_end) + 1;
+		if (value_start == 0) break;
+		const size_t value_end = skipJsonValue(record, value_start);
+
+		const std::string key = unescapeJsonString(record.substr(key_start, key_end - key_start));
+		const std::string value = record.substr(value_start, value_end - value_start);
+		if (key == "ts")
+			seconds = atof(value.c_str());
+		else if (key == "msg")
+			message = unescapeJsonString(value);
+		else if (key != "level" && key != "file" && key != "line" && key != "thread")
+			fields += " " + key + "=" + (value[0] == '"' ? unescapeJsonString(value) : value);
+
+		position = value_end < record.length() && record[value_end] == ',' ? value_end : std::string::npos;
+	}
+
+	const time_t whole = (time_t) seconds;
+	tm t;
+	localtime_r(&whole, &t);
+	char clock[32];
+	snprintf(clock, sizeof(clock), "%02d:%02d:%02d.%03d", t.tm_hour, t.tm_min, t.tm_sec,
+			(int) ((seconds - whole) * 1000));
+
+	std::string out = clock;
+	if (block.line > 0) out += " " + block.file + ":" + std::to_string(block.line);
+	char level[8];
+	snprintf(level, sizeof(level), "%-5s", LevelNames[block.level]);
+	return out + " " + level + "\t" + message + fields;
+}
+
+int main(int argc, char** argv)
+{
+	double from = -INFINITY, to = INFINITY;
+	int severity = 0;
+	const char* site = NULL;
+	const char* output = NULL;
+	bool count = false;
+
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; ++arg)
+	{
+		const char option = argv[arg][1];
+		if (option == 'c')
+		{
+			count = true;
+			continue;
+		}
+		if (arg + 1 >= argc) break;
+
+		const char* value = argv[++arg];
+		const int level = option == 'l' ? getLevel(value) : 0;
+		if ((option == 'f' && !parseTime(value, from)) || (option == 't' && !parseTime(value, to)) || level < 0)
+		{
+			fprintf(stderr, "invalid -%c %s\n", option, value);
+			return EXIT_FAILURE;
+		}
+
+		if (option == 'l') severity = Severities[level];
+		if (option == 's') site = value;
+		if (option == 'o') output = value;
+	}
+	if (arg + 1 != argc)
+	{
+		fprintf(stderr, "usage: %s [-f from] [-t to] [-l level] [-s site] [-o text|json] [-c] <log file>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const std::string log_name = argv[arg];
+	FILE* index = fopen((log_name + ".idx").c_str(), "rb");
+	FILE* log = fopen(log_name.c_str(), "rb");
+	if (index == NULL || log == NULL)
+	{
+		perror(index == NULL ? (log_name + ".idx").c_str() : log_name.c_str());
+		return EXIT_FAILURE;
+	}
+
+	std::string magic;
+	uint32_t version, bucket_ms;
+	if (!readBytes(index, magic, 8) || magic != "CVLOGIDX" || !readLittleEndian(index, version) || version != 1
+			|| !readLittleEndian(index, bucket_ms))
+	{
+		fprintf(stderr, "%s.idx: not a log index\n", log_name.c_str());
+		return EXIT_FAILURE;
+	}
+
+	struct stat status;
+	const uint64_t log_size = fstat(fileno(log), &status) == 0 ? status.st_size : 0;
+
+	std::vector<Block> blocks;
+	std::map<std::string, uint64_t> counts;
+	uint64_t indexed = 0; // end of the last record in the index
+
+	Block block;
+	std::vector<Record> records;
+	while (readBlock(index, block))
+	{
+		records.clear();
+		getRecords(block, records);
+		if (!records.empty()) indexed = std::max(indexed, records.back().offset + records.back().length + 1);
+
+		const double start = block.bucket / 1e6;
+		const std::string name = block.file + ":" + std::to_string(block.line);
+		if (start + bucket_ms / 1000.0 <= from || start > to || Severities[block.level] < severity
+				|| (site != NULL && fnmatch(site, name.c_str(), 0) != 0))
+		{
+			continue;
+		}
+
+		if (count)
+			counts[std::string(LevelNames[block.level]) + "\t" + name] += block.count;
+		else
+			blocks.push_back(block);
+	}
+	fclose(index);
+
+	if (count)
+	{
+		for (std::map<std::string, uint64_t>::const_iterator c = counts.begin(); c != counts.end(); ++c)
+			printf("%llu\t%s\n", (unsigned long long) c->second, c->first.c_str());
+		return EXIT_SUCCESS;
+	}
+
+	records.clear();
+	for (size_t b = 0; b < blocks.size(); ++b)
+		getRecords(blocks[b], records);
+	std::sort(records.begin(), records.end());
+
+	std::string text;
+	for (size_t r = 0; r < records.size(); ++r)
+	{
+		const Record &record = records[r];
+		if (record.offset + record.length > log_size) break;
+
+		text.resize(record.length);
+		if (fseeko(log, record.offset, SEEK_SET) != 0 || (record.length > 0 && fread(&text[0], 1, record.length, log)
+				!= record.length))
+		{
+			perror(log_name.c_str());
+			return EXIT_FAILURE;
+		}
+
+		// the exact time where the record has one, the bucket is all the index has
+		const bool json = !text.empty() && text[0] == '{';
+		double seconds = NAN;
+		if (json && text.compare(0, 6, "{\"ts\":") == 0)
+			seconds = atof(text.c_str() + 6);
+		else if (!json && !getTextTime(text, record.block->bucket, seconds)) seconds = NAN;
+		if (!std::isnan(seconds) && (seconds < from || seconds > to)) continue;
+
+		if (output != NULL && strcmp(output, "json") == 0 && !json)
+			text = textToJson(text, *record.block);
+		else if (output != NULL && strcmp(output, "text") == 0 && json)
+			text = jsonToText(text, *record.block);
+
+		fwrite(text.data(), 1, text.length(), stdout);
+		fputc('\n', stdout);
+	}
+	fclose(log);
+
+	if (log_size > indexed)
+		fprintf(stderr, "%llu bytes at the end of %s are not indexed yet\n",
+				(unsigned long long) (log_size - indexed), log_name.c_str());
+
+	return EXIT_SUCCESS;
+}